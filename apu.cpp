@@ -1,32 +1,65 @@
 #include "apu.h"
+#include <algorithm>
+#include <cassert>
 
 // Static Tables
 
 const std::array<uint8_t, 4> Channel::vol_code = {4, 0, 1, 2};
 const std::array<uint8_t, 8> Channel::divisors = {4, 8, 16, 24, 32, 40, 48, 56};
 const std::array<uint8_t, 4> Channel::duty_cycles = {0x01, 0x81, 0x87, 0x7e};
+const LsfrTable Channel::lsfr15(false), Channel::lsfr7(true);
+
+// LFSR Functions
+
+LsfrTable::LsfrTable(bool width7_in)
+    : width7(width7_in), index(width7 ? 0x80 : 0x8000, 0xffff) {
+  // walk past transient states left from other width
+  uint16_t lsfr = 0x7fff;
+  for (unsigned i = 0; i < 8; ++i)
+    lsfr = step(lsfr, width7);
+  // record cycle, 32767 states for 15 bits or 127 for 7 bits
+  while (find(lsfr) == 0xffff) {
+    index[lsfr & (index.size() - 1)] = states.size();
+    states.push_back(lsfr);
+    lsfr = step(lsfr, width7);
+  }
+}
+
+uint16_t LsfrTable::find(uint16_t lsfr) const {
+  // on the 7 bit cycle, the low 7 bits determine the whole register
+  uint16_t i = index[lsfr & (index.size() - 1)];
+  return i != 0xffff && states[i] == lsfr ? i : 0xffff;
+}
+
+uint16_t LsfrTable::step(uint16_t lsfr, bool width7) {
+  bool bit = read1(lsfr, 0) ^ read1(lsfr, 1);
+  lsfr = write1(lsfr >> 1, 14, bit);
+  return width7 ? write1(lsfr, 6, bit) : lsfr;
+}
+
+uint16_t LsfrTable::jump(uint16_t lsfr, unsigned steps) const {
+  // single steps are cheaper to shift than to look up
+  if (steps == 1) return step(lsfr, width7);
+  // step one at a time until on cycle, at most 8 steps after width change
+  uint16_t i = find(lsfr);
+  for (; steps > 0 && i == 0xffff; --steps) {
+    if (lsfr == 0) return 0;
+    lsfr = step(lsfr, width7);
+    i = find(lsfr);
+  }
+  if (steps == 0) return lsfr;
+  return states[(i + steps) % states.size()];
+}
 
 // Channel Functions
 
-Channel::Channel(CT type_in, Memory &mem_in) : mem(mem_in), type(type_in) {
-  // set r/w permission bitmasks
-  mem.rmask(Range(addr, addr + 4), 0x0);
-  // create on-write hooks
-  mem.hook(addr + 4, [&](uint8_t val) {
-    if (read1(val, 7)) enable();
-  });
-  if (type == CT::wave) {
-    mem.hook(addr, [&](uint8_t val) {
-      if (!read1(val, 7)) on = false;
-    });
-    mem.hook(addr + 1, [&](uint8_t val) { len = 0x100 - val; });
-    mem.hook(addr + 2, [&](uint8_t val) { vol = vol_code[(val >> 5) & 0x3]; });
-  } else
-    mem.hook(addr + 1, [&](uint8_t val) { len = 0x40 - (val & 0x3f); });
+Channel::Channel(CT type_in) : type(type_in) {
+  wave_ram.fill(0);
 }
 
 void Channel::enable() {
-  on = true, timer = 1, lsfr = 0xff;
+  on = true;
+  timer = 1, lsfr = 0xff;
   vol_len = nr2 & 0x7;
   if (type == CT::wave) wave_pt = 0;
   if (len == 0) len = (type != CT::wave ? 0x3f : 0xff);
@@ -49,7 +82,8 @@ void Channel::update_sweep() {
 
 void Channel::update_frame(uint8_t frame_pt) {
   // update length counter
-  if (read1(frame_pt, 0) && read1(nr4, 6) && len > 0 && --len == 0) on = false;
+  if (read1(frame_pt, 0) && read1(nr4, 6) && len > 0 && --len == 0)
+    on = false;
   // update volume envelope
   if (frame_pt == 7 && type != CT::wave && vol_len > 0 && --vol_len == 0) {
     vol = read1(nr2, 3) ? vol + (vol < 0xf) : vol - (vol > 0);
@@ -65,80 +99,236 @@ void Channel::update_frame(uint8_t frame_pt) {
   }
 }
 
-void Channel::update_wave() {
-  // advance 1 sample in waveform
+uint16_t Channel::period() const {
+  // find timer reload value for current frequency
+  switch (type) {
+  case CT::square1:
+  case CT::square2: return ((0x800 - (((nr4 & 0x7) << 8) | nr3)) << 1) + 1;
+  case CT::wave: return (0x800 - (((nr4 & 0x7) << 8) | nr3)) + 1;
+  case CT::noise: return (divisors[nr3 & 0x7] << (nr3 >> 4)) + 1;
+  }
+  return 0;
+}
+
+void Channel::advance(unsigned steps) {
+  // advance n samples in waveform
   switch (type) {
   case CT::square1:
   case CT::square2: {
-    uint16_t freq = ((nr4 & 0x7) << 8) | nr3;
-    timer = ((0x800 - freq) << 1) + 1;
-    wave_pt = (wave_pt + 1) & 0x7;
+    wave_pt = (wave_pt + steps) & 0x7;
     uint8_t duty = nr1 >> 6;
     output = on * vol * read1(duty_cycles[duty], wave_pt);
     break;
   }
   case CT::wave: {
-    uint16_t freq = ((nr4 & 0x7) << 8) | nr3;
-    timer = (0x800 - freq) + 1;
-    wave_pt = (wave_pt + 1) & 0x1f;
-    uint8_t wave_s = mem.refh(0x30 + (wave_pt >> 1));
-    wave_s = read1(wave_pt, 0) ? wave_s >> 4 : wave_s & 0xf;
-    output = on * (wave_s >> vol);
+    wave_pt = (wave_pt + steps) & 0x1f;
+    output = on * (wave_ram[wave_pt] >> vol);
     break;
   }
   case CT::noise: {
-    uint8_t div_code = nr3 & 0x7;
-    bool bit = read1(lsfr, 0) ^ read1(lsfr, 1);
-    timer = (divisors[div_code] << (nr3 >> 4)) + 1;
-    lsfr = write1(lsfr >> 1, 14, bit);
-    if (read1(nr3, 3)) lsfr = write1(lsfr, 6, bit);
+    lsfr = (read1(nr3, 3) ? lsfr7 : lsfr15).jump(lsfr, steps);
     output = on * vol * !read1(lsfr, 0);
     break;
   }
   }
 }
 
+void Channel::update_wave() {
+  // advance 1 sample in waveform
+  timer = period();
+  advance(1);
+}
+
+void Channel::skip(unsigned clocks) {
+  // advance timer without generating output
+  unsigned remaining = timer != 0 ? timer : 0x10000;
+  if (clocks < remaining) {
+    timer -= clocks;
+    return;
+  }
+  unsigned reload = period();
+  clocks -= remaining;
+  timer = reload - clocks % reload;
+  advance(1 + clocks / reload);
+}
+
+void Channel::write(uint8_t reg, uint8_t val) {
+  // side effects see previous register value, so store last
+  switch (reg) {
+  case 0:
+    if (type == CT::wave && !read1(val, 7)) on = false;
+    nr0 = val;
+    break;
+  case 1:
+    len = type == CT::wave ? 0x100 - val : 0x40 - (val & 0x3f);
+    nr1 = val;
+    break;
+  case 2:
+    if (type == CT::wave) vol = vol_code[(val >> 5) & 0x3];
+    nr2 = val;
+    break;
+  case 3:
+    nr3 = val;
+    break;
+  case 4:
+    if (read1(val, 7)) enable();
+    nr4 = val;
+    break;
+  }
+}
+
+uint8_t Channel::read_wave(uint8_t i) const {
+  // on DMG, wave RAM is only reachable in the cycle the channel reads it,
+  // so treat it as inaccessible while playing
+  if (on) return 0xff;
+  return wave_ram[i << 1] | (wave_ram[(i << 1) + 1] << 4);
+}
+
+void Channel::write_wave(uint8_t i, uint8_t val) {
+  // cache decoded wave RAM samples
+  if (on) return;
+  wave_ram[i << 1] = val & 0xf;
+  wave_ram[(i << 1) + 1] = val >> 4;
+}
+
 // Core Functions
 
-APU::APU(Memory &mem_in) : mem(mem_in) {
-  // create resampling buffers
-  left_buffer = blip_new(4410), right_buffer = blip_new(4410);
-  blip_set_rates(left_buffer, 2097152, 44100 * 1.01);
-  blip_set_rates(right_buffer, 2097152, 44100 * 1.01);
-  // set initial register values
-  nr50 = 0x77, nr51 = 0xf3, nr52 = 0xf1;
-  // create on-write hooks
-  mem.hook(0xff24, [&](uint8_t val) {
-    left_vol = ((val >> 4 & 0x7) + 1) * 16;
-    right_vol = ((val & 0x7) + 1) * 16;
-  });
-  mem.hook(0xff25, [&](uint8_t val) {
-    for (unsigned i = 0; i < 4; ++i) {
-      channels[i].left_on = read1(val, 4 + i);
-      channels[i].right_on = read1(val, i);
-    }
-  });
+APU::APU(const AudioConfig &config)
+    : outputs(config.mono ? 1 : 2), capacity(config.capacity),
+      rate(config.rate) {
+  assert(config.rate >= 22050 && config.rate <= 96000);
+  // buffers must hold a whole DMG frame of output beyond the ~2ms margin,
+  // or the overflow check would discard audio every frame
+  unsigned margin = config.rate / 441;
+  unsigned frame = config.rate * 70224ull / 4194304 + 1;
+  assert(config.capacity >= margin + frame);
+  // create resampling buffers, leaving room for margin past overflow check
+  overflow = static_cast<int>(capacity - margin);
+  for (unsigned i = 0; i < outputs; ++i) {
+    buffers[i] = blip_new(capacity);
+    blip_set_rates(buffers[i], 2097152, rate);
+  }
 }
 
 APU::~APU() {
-  blip_delete(left_buffer);
-  blip_delete(right_buffer);
+  for (blip_t *buffer : buffers)
+    blip_delete(buffer);
 }
 
-const std::vector<int16_t> &APU::read_audio() {
-  blip_end_frame(left_buffer, sample + 1);
-  blip_end_frame(right_buffer, sample + 1);
+void APU::update_rate(size_t queued) {
+  fill = queued;
+  // zero latency disables control when frontend already paces by audio
+  if (latency == 0 && ratio == 1) return;
+  if (latency == 0) {
+    ratio = 1, drift = 0;
+  } else {
+    // nudge output rate by up to 0.5% towards target latency,
+    // integrating error to cancel out steady clock drift
+    double error = (static_cast<double>(latency) - queued) / latency;
+    error = std::max(-1.0, std::min(1.0, error));
+    drift = std::max(-1.0, std::min(1.0, drift + error / 64));
+    ratio = 1 + 0.005 * std::max(-1.0, std::min(1.0, error + drift));
+  }
+  for (blip_t *buffer : buffers)
+    if (buffer != nullptr) blip_set_rates(buffer, 2097152, rate * ratio);
+}
+
+void APU::set_synth(bool on) {
+  if (on == synth) return;
+  for (blip_t *buffer : buffers)
+    if (buffer != nullptr) blip_clear(buffer);
+  sample = 0, synth = on;
+}
+
+void APU::end_frame() {
+  for (blip_t *buffer : buffers)
+    if (buffer != nullptr) blip_end_frame(buffer, sample + 1);
   sample = 0;
+}
+
+size_t APU::read_samples(int16_t *dst, size_t max_frames) {
+  // interleave outputs directly into destination
+  int size = std::min<size_t>(max_frames, blip_samples_avail(buffers[0]));
+  for (unsigned i = 0; i < outputs; ++i)
+    blip_read_samples(buffers[i], dst + i, size, outputs == 2);
+  wavs[0].write(dst, size * outputs);
+  return size;
+}
+
+size_t APU::read_audio(int16_t *dst, size_t max_frames) {
+  if (!synth) return 0;
+  end_frame();
+  size_t size = read_samples(dst, max_frames);
+  read_stems(size);
+  return size;
+}
+
+void APU::read_audio(AudioRing &ring) {
+  if (!synth) return;
+  end_frame();
+  update_rate(ring.size() / outputs);
+
+  // read directly into free space, which may wrap around
+  size_t total = 0;
+  for (unsigned i = 0; i < 2; ++i) {
+    size_t space;
+    int16_t *out = ring.write_ptr(space);
+    size_t size = read_samples(out, space / outputs);
+    if (size == 0) break;
+    ring.commit(size * outputs);
+    total += size;
+  }
+  read_stems(total);
+}
+
+void APU::read_stems(size_t size) {
+  // read as many samples from each stem as from the mix,
+  // staying within capacity reserved in set_stems
+  for (unsigned i = 0; i < 4; ++i) {
+    if (buffers[2 + i] == nullptr) continue;
+    stems[i].resize(size);
+    int read = blip_read_samples(buffers[2 + i], &stems[i][0], size, false);
+    stems[i].resize(read);
+    wavs[1 + i].write(stems[i].data(), stems[i].size());
+  }
+}
 
-  int size = blip_samples_avail(right_buffer);
-  audio.resize(size * 2);
-  blip_read_samples(left_buffer, &audio[0], size, true);
-  blip_read_samples(right_buffer, &audio[1], size, true);
-  return audio;
+void APU::set_stems(bool on) {
+  for (unsigned i = 0; i < 4; ++i) {
+    blip_t *&buffer = buffers[2 + i];
+    if (!on) {
+      blip_delete(buffer);
+      buffer = nullptr, stems[i].clear();
+    } else if (buffer == nullptr) {
+      buffer = blip_new(capacity);
+      blip_set_rates(buffer, 2097152, rate * ratio);
+      stems[i].reserve(capacity);
+    }
+  }
+}
+
+bool APU::record(const std::string &filename, bool with_stems) {
+  // write mix, and optionally each channel, to separate files
+  static const std::array<const char *, 4> names = {
+      {"square1", "square2", "wave", "noise"}};
+  set_stems(with_stems);
+  bool ok = wavs[0].open(filename, rate, outputs);
+  std::string base = filename.substr(0, filename.rfind(".wav"));
+  for (unsigned i = 0; ok && with_stems && i < 4; ++i)
+    ok = wavs[1 + i].open(base + "_" + names[i] + ".wav", rate, 1);
+  // don't leave a partial set of files recording
+  if (!ok) stop_recording();
+  return ok;
+}
+
+void APU::stop_recording() {
+  for (WavWriter &wav : wavs)
+    wav.close();
+  set_stems(false);
 }
 
-void APU::update(unsigned cpu_cycles) {
-  // update frame sequencer
+void APU::update(unsigned cpu_cycles, uint8_t div) {
+  // update frame sequencer from DIV
   bool bit = read1(div, 4);
   if (last_bit && !bit) {
     frame_pt = (frame_pt + 1) & 0x7;
@@ -146,30 +336,80 @@ void APU::update(unsigned cpu_cycles) {
       channel.update_frame(frame_pt);
   }
   last_bit = bit;
-  // update wave generator
-  for (unsigned i = 0; i < cpu_cycles * 2; ++i) {
-    if ((sample = (sample + 1) & 0x7ff) == 0) {
-      if (blip_samples_avail(right_buffer) > 4310) {
-        blip_clear(left_buffer);
-        blip_clear(right_buffer);
+  // skip waveform generation when not synthesizing
+  if (!synth) {
+    for (Channel &channel : channels)
+      channel.skip(cpu_cycles * 2);
+    return;
+  }
+  // update wave generator at each channel timer expiry
+  unsigned clocks = cpu_cycles * 2;
+  while (clocks > 0) {
+    unsigned step = std::min(clocks, 0x800u - sample);
+    for (const Channel &channel : channels)
+      step = std::min(step, channel.timer != 0 ? channel.timer : 0x10000u);
+    clocks -= step;
+    if ((sample = (sample + step) & 0x7ff) == 0) {
+      bool full = blip_samples_avail(buffers[0]) > overflow;
+      for (blip_t *buffer : buffers) {
+        if (buffer == nullptr) continue;
+        if (full) blip_clear(buffer);
+        blip_end_frame(buffer, 0x800);
       }
-      blip_end_frame(left_buffer, 0x800);
-      blip_end_frame(right_buffer, 0x800);
     }
 
     int16_t left_delta = 0, right_delta = 0;
-    for (Channel &channel : channels) {
-      if (--channel.timer != 0) continue;
+    for (unsigned i = 0; i < 4; ++i) {
+      Channel &channel = channels[i];
+      if ((channel.timer -= step) != 0) continue;
       channel.update_wave();
       int16_t delta = channel.get_output() - channel.last_out;
       channel.last_out += delta;
       if (channel.left_on) left_delta += delta;
       if (channel.right_on) right_delta += delta;
+      if (buffers[2 + i] != nullptr && delta != 0)
+        blip_add_delta(buffers[2 + i], sample, delta * 128);
     }
 
+    if (outputs == 1) {
+      // mix both sides down to mono
+      int delta = (left_delta * left_vol + right_delta * right_vol) / 2;
+      if (delta != 0) blip_add_delta(buffers[0], sample, delta);
+      continue;
+    }
     if (left_delta != 0)
-      blip_add_delta(left_buffer, sample, left_delta * left_vol);
+      blip_add_delta(buffers[0], sample, left_delta * left_vol);
     if (right_delta != 0)
-      blip_add_delta(right_buffer, sample, right_delta * right_vol);
+      blip_add_delta(buffers[1], sample, right_delta * right_vol);
   }
 }
+
+// I/O Functions
+
+uint8_t APU::read(uint8_t reg) const {
+  // channel registers are write only
+  if (reg == 0x24) return nr50;
+  if (reg == 0x25) return nr51;
+  if (reg == 0x26) return nr52;
+  if (reg >= 0x30) return channels[2].read_wave(reg - 0x30);
+  return 0xff;
+}
+
+void APU::write(uint8_t reg, uint8_t val) {
+  if (reg < 0x24) {
+    channels[(reg - 0x10) / 5].write((reg - 0x10) % 5, val);
+  } else if (reg == 0x24) {
+    nr50 = val;
+    left_vol = ((val >> 4 & 0x7) + 1) * 16;
+    right_vol = ((val & 0x7) + 1) * 16;
+  } else if (reg == 0x25) {
+    nr51 = val;
+    for (unsigned i = 0; i < 4; ++i) {
+      channels[i].left_on = read1(val, 4 + i);
+      channels[i].right_on = read1(val, i);
+    }
+  } else if (reg == 0x26) {
+    nr52 = val;
+  } else if (reg >= 0x30)
+    channels[2].write_wave(reg - 0x30, val);
+}
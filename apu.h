@@ -3,78 +3,133 @@
 
 #include "blip_buf.h"
 #include "memory.h"
+#include "spsc.h"
+#include "wav.h"
+
+// Interleaved output samples shared with audio callback
+typedef Ring<int16_t, 0x2000> AudioRing;
+
+// Output Settings
+struct AudioConfig {
+  unsigned rate = 44100;
+  unsigned capacity = 4410;
+  bool mono = false;
+};
 
 // Channel Types
 enum class CT { square1, square2, wave, noise };
 
+// Precomputed noise LFSR cycle for one width
+class LsfrTable {
+private:
+  // Internal State
+  const bool width7;
+  std::vector<uint16_t> states, index;
+  uint16_t find(uint16_t lsfr) const;
+
+public:
+  // Core Functions
+  explicit LsfrTable(bool width7_in);
+  static uint16_t step(uint16_t lsfr, bool width7);
+  uint16_t jump(uint16_t lsfr, unsigned steps) const;
+};
+
 class Channel {
 private:
   // Static Tables
   static const std::array<uint8_t, 4> vol_code;
   static const std::array<uint8_t, 8> divisors;
   static const std::array<uint8_t, 4> duty_cycles;
+  static const LsfrTable lsfr15, lsfr7;
 
   // Internal State
-  Memory &mem;
   const CT type;
-  const uint16_t addr = 0xff10 + static_cast<uint16_t>(type) * 5;
 
   bool on = false, sweep_on = false;
   uint8_t wave_pt = 0, vol = 16, output = 0;
   uint16_t len = 0, vol_len = 0;
   uint16_t sweep_len = 0;
   uint16_t lsfr = 0;
+  std::array<uint8_t, 32> wave_ram;
   void enable();
+  uint16_t period() const;
+  void advance(unsigned steps);
 
   // Registers
-  uint8_t &nr0 = mem.ref(addr);
-  uint8_t &nr1 = mem.ref(addr + 1);
-  uint8_t &nr2 = mem.ref(addr + 2);
-  uint8_t &nr3 = mem.ref(addr + 3);
-  uint8_t &nr4 = mem.ref(addr + 4);
+  uint8_t nr0 = 0, nr1 = 0, nr2 = 0, nr3 = 0, nr4 = 0;
 
 public:
   // Core Functions
   uint16_t timer = 0;
   int16_t last_out = 0;
   bool left_on = true, right_on = true;
-  Channel(CT type_in, Memory &mem_in);
+  explicit Channel(CT type_in);
   void update_sweep();
   void update_frame(uint8_t frame_pt);
   void update_wave();
+  void skip(unsigned clocks);
   const uint8_t &get_output() const { return output; }
   CT get_type() const { return type; }
+
+  // I/O Functions
+  void write(uint8_t reg, uint8_t val);
+  uint8_t read_wave(uint8_t i) const;
+  void write_wave(uint8_t i, uint8_t val);
 };
 
 class APU {
 private:
   // Internal State
-  Memory &mem;
   uint16_t sample = 0;
   uint8_t frame_pt = 0;
-  bool last_bit = 0;
+  bool last_bit = 0, synth = true;
   std::array<Channel, 4> channels = {{
-      Channel(CT::square1, mem),
-      Channel(CT::square2, mem),
-      Channel(CT::wave, mem),
-      Channel(CT::noise, mem),
+      Channel(CT::square1),
+      Channel(CT::square2),
+      Channel(CT::wave),
+      Channel(CT::noise),
   }};
   uint8_t left_vol = 128, right_vol = 128;
-  blip_t *left_buffer, *right_buffer;
-  std::vector<int16_t> audio;
+  std::array<blip_t *, 6> buffers = {{}};
+  std::array<WavWriter, 5> wavs;
+  std::array<std::vector<int16_t>, 4> stems;
+  unsigned outputs, capacity;
+  int overflow;
+  double rate, ratio = 1, drift = 0;
+  size_t latency = 2048, fill = 0;
+  void end_frame();
+  size_t read_samples(int16_t *dst, size_t max_frames);
+  void read_stems(size_t size);
 
   // Registers
-  uint8_t &div = mem.refh(0x04);
-  uint8_t &nr50 = mem.refh(0x24);
-  uint8_t &nr51 = mem.refh(0x25);
-  uint8_t &nr52 = mem.refh(0x26);
+  uint8_t nr50 = 0x77, nr51 = 0xf3, nr52 = 0xf1;
 
 public:
   // Core Functions
-  explicit APU(Memory &mem_in);
+  explicit APU(const AudioConfig &config);
   ~APU();
-  void update(unsigned cpu_cycles);
-  const std::vector<int16_t> &read_audio();
+  void update(unsigned cpu_cycles, uint8_t div);
+  void set_synth(bool on);
+  // target queued frames for rate control, zero turns it off
+  void set_latency(size_t frames) { latency = frames; }
+  void update_rate(size_t queued);
+  size_t get_fill() const { return fill; }
+  double get_rate() const { return rate * ratio; }
+  size_t read_audio(int16_t *dst, size_t max_frames);
+  void read_audio(AudioRing &ring);
+  unsigned get_outputs() const { return outputs; }
+
+  // Recording Functions
+  void set_stems(bool on);
+  const std::vector<int16_t> &get_stem(CT type) const {
+    return stems[static_cast<unsigned>(type)];
+  }
+  bool record(const std::string &filename, bool with_stems);
+  void stop_recording();
+
+  // I/O Functions
+  uint8_t read(uint8_t reg) const;
+  void write(uint8_t reg, uint8_t val);
 };
 
 #endif
@@ -0,0 +1,32 @@
+// consume interleaved samples from the emulator's shared audio ring
+
+class RingProcessor extends AudioWorkletProcessor {
+  constructor(options) {
+    super();
+    // ring layout is head at byte 0, tail at byte 64, samples from byte 128
+    const {buffer, ring, capacity, channels} = options.processorOptions;
+    this.counters = new Uint32Array(buffer, ring, 32);
+    this.samples = new Int16Array(buffer, ring + 128, capacity);
+    this.mask = capacity - 1;
+    this.channels = channels;
+  }
+
+  process(inputs, outputs) {
+    const output = outputs[0], channels = this.channels;
+    const head = Atomics.load(this.counters, 0);
+    const tail = Atomics.load(this.counters, 16);
+    const queued = Math.floor(((tail - head) >>> 0) / channels);
+    const count = Math.min(output[0].length, queued);
+    for (let c = 0; c < channels; ++c) {
+      const out = output[c];
+      for (let i = 0; i < count; ++i)
+        out[i] = this.samples[(head + channels * i + c) & this.mask] / 32768;
+      // silence on underrun
+      out.fill(0, count);
+    }
+    Atomics.store(this.counters, 0, head + channels * count);
+    return true;
+  }
+}
+
+registerProcessor('ring-processor', RingProcessor);
@@ -0,0 +1,62 @@
+#include "blip_buf.h"
+#include "gameboy.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Benchmark Functions
+
+double bench_blip(unsigned &checksum) {
+  // add deltas at Game Boy half-cycle rate, one second per frame
+  blip_t *buffer = blip_new(48000);
+  blip_set_rates(buffer, 2097152, 44100);
+  std::vector<short> out(48000);
+  auto start = std::chrono::steady_clock::now();
+  unsigned seed = 1, deltas = 0;
+  for (unsigned frame = 0; frame < 20; ++frame) {
+    for (unsigned t = 0; t < 2097152; t += 1 + (seed >> 29)) {
+      seed = seed * 1103515245 + 12345;
+      blip_add_delta(buffer, t, static_cast<int>(seed >> 16 & 0x3fff) - 0x2000);
+      ++deltas;
+    }
+    blip_end_frame(buffer, 2097152);
+    int count = blip_read_samples(buffer, &out[0], out.size(), 0);
+    for (int i = 0; i < count; ++i)
+      checksum = checksum * 31 + static_cast<unsigned short>(out[i]);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  blip_delete(buffer);
+  return deltas / elapsed.count();
+}
+
+double bench_frames(unsigned &checksum) {
+  // copy loop over work ram, so runtime is dominated by memory accesses
+  std::vector<uint8_t> rom(0x8000);
+  const std::array<uint8_t, 15> code = {0xf3, 0x21, 0x00, 0xc0, 0x2a,
+                                        0x77, 0x7c, 0xfe, 0xdf, 0x20,
+                                        0xf9, 0x26, 0xc0, 0x18, 0xf5};
+  std::copy(code.begin(), code.end(), &rom[0x100]);
+  Gameboy gameboy(&rom[0], rom.size());
+  gameboy.set_audio(false);
+  auto start = std::chrono::steady_clock::now();
+  const unsigned frames = 2000;
+  for (unsigned frame = 0; frame < frames; ++frame) {
+    gameboy.update(false);
+    checksum = checksum * 31 + gameboy.cpu.get_pc();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return frames / elapsed.count();
+}
+
+int main() {
+  unsigned checksum = 0;
+  double rate = bench_blip(checksum);
+  printf("blip_add_delta: %.1f M deltas/s (checksum %08x)\n", rate / 1e6,
+         checksum);
+  checksum = 0;
+  rate = bench_frames(checksum);
+  printf("memory bound frames: %.1f frames/s (checksum %08x)\n", rate,
+         checksum);
+}
@@ -22,6 +22,15 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
 	#include "blargg_test.h"
 #endif
 
+/* Vectorised kernel add, define BLIP_NO_SIMD to use scalar code only */
+#if !defined (BLIP_NO_SIMD) && (defined (__SSE2__) || defined (_M_X64))
+	#include <emmintrin.h>
+	#define BLIP_SSE2 1
+#elif !defined (BLIP_NO_SIMD) && defined (__wasm_simd128__)
+	#include <wasm_simd128.h>
+	#define BLIP_WASM_SIMD 1
+#endif
+
 /* Equivalent to ULONG_MAX >= 0xFFFFFFFF00000000.
 Avoids constants that don't fit in 32 bits. */
 #if ULONG_MAX/0xFFFFFFFF > 0xFFFFFFFF
@@ -308,6 +317,56 @@ void blip_add_delta( blip_t* m, unsigned time, int delta )
 	/* Fails if buffer size was exceeded */
 	assert( out <= &SAMPLES( m ) [m->size + end_frame_extra] );
 	
+#if defined (BLIP_SSE2) || defined (BLIP_WASM_SIMD)
+	/* Both halves reduce to pairwise 16-bit multiply-adds of kernel taps with
+	(delta, delta2), which is exact when delta fits in 16 bits. */
+	if ( (short) delta == delta && (short) delta2 == delta2 )
+	{
+	#if defined (BLIP_SSE2)
+		__m128i const d   = _mm_set1_epi32( (int) ((delta & 0xFFFF) | ((unsigned) delta2 << 16)) );
+		__m128i const a   = _mm_loadu_si128( (__m128i const*) in );
+		__m128i const b   = _mm_loadu_si128( (__m128i const*) (in + half_width) );
+		__m128i       c   = _mm_loadu_si128( (__m128i const*) rev );
+		__m128i       e   = _mm_loadu_si128( (__m128i const*) (rev - half_width) );
+		__m128i*      o   = (__m128i*) out;
+		
+		/* Second half walks kernel backwards */
+		c = _mm_shuffle_epi32( _mm_shufflehi_epi16( _mm_shufflelo_epi16( c, 0x1B ), 0x1B ), 0x4E );
+		e = _mm_shuffle_epi32( _mm_shufflehi_epi16( _mm_shufflelo_epi16( e, 0x1B ), 0x1B ), 0x4E );
+		
+		_mm_storeu_si128( o + 0, _mm_add_epi32( _mm_loadu_si128( o + 0 ),
+				_mm_madd_epi16( _mm_unpacklo_epi16( a, b ), d ) ) );
+		_mm_storeu_si128( o + 1, _mm_add_epi32( _mm_loadu_si128( o + 1 ),
+				_mm_madd_epi16( _mm_unpackhi_epi16( a, b ), d ) ) );
+		_mm_storeu_si128( o + 2, _mm_add_epi32( _mm_loadu_si128( o + 2 ),
+				_mm_madd_epi16( _mm_unpacklo_epi16( c, e ), d ) ) );
+		_mm_storeu_si128( o + 3, _mm_add_epi32( _mm_loadu_si128( o + 3 ),
+				_mm_madd_epi16( _mm_unpackhi_epi16( c, e ), d ) ) );
+	#else
+		v128_t const d = wasm_i16x8_make( delta, delta2, delta, delta2,
+				delta, delta2, delta, delta2 );
+		v128_t const a = wasm_v128_load( in );
+		v128_t const b = wasm_v128_load( in + half_width );
+		v128_t       c = wasm_v128_load( rev );
+		v128_t       e = wasm_v128_load( rev - half_width );
+		
+		/* Second half walks kernel backwards */
+		c = wasm_i16x8_shuffle( c, c, 7, 6, 5, 4, 3, 2, 1, 0 );
+		e = wasm_i16x8_shuffle( e, e, 7, 6, 5, 4, 3, 2, 1, 0 );
+		
+		wasm_v128_store( out + 0, wasm_i32x4_add( wasm_v128_load( out + 0 ),
+				wasm_i32x4_dot_i16x8( wasm_i16x8_shuffle( a, b, 0, 8, 1, 9, 2, 10, 3, 11 ), d ) ) );
+		wasm_v128_store( out + 4, wasm_i32x4_add( wasm_v128_load( out + 4 ),
+				wasm_i32x4_dot_i16x8( wasm_i16x8_shuffle( a, b, 4, 12, 5, 13, 6, 14, 7, 15 ), d ) ) );
+		wasm_v128_store( out + 8, wasm_i32x4_add( wasm_v128_load( out + 8 ),
+				wasm_i32x4_dot_i16x8( wasm_i16x8_shuffle( c, e, 0, 8, 1, 9, 2, 10, 3, 11 ), d ) ) );
+		wasm_v128_store( out + 12, wasm_i32x4_add( wasm_v128_load( out + 12 ),
+				wasm_i32x4_dot_i16x8( wasm_i16x8_shuffle( c, e, 4, 12, 5, 13, 6, 14, 7, 15 ), d ) ) );
+	#endif
+		return;
+	}
+#endif
+	
 	out [0] += in[0]*delta + in[half_width+0]*delta2;
 	out [1] += in[1]*delta + in[half_width+1]*delta2;
 	out [2] += in[2]*delta + in[half_width+2]*delta2;
@@ -161,14 +161,14 @@ inline void CPU::bit(uint8_t n, uint8_t a) {
 
 void CPU::check_interrupts() {
   // call appropriate interrupt, lower bit priority
-  uint8_t interrupt = ffs(IF & IE & 0x1f);
+  uint8_t interrupt = ffs(mem.pending());
   if (interrupt == 0) return;
   if (ime) {
     if (halt) ++cycles;
     sp -= 2;
     mem.write16(sp, pc);
     pc = 0x40 + 0x8 * (interrupt - 1);
-    IF = write1(IF, interrupt - 1, false);
+    mem.acknowledge(interrupt - 1);
     ime = false;
     cycles += 5;
   }
@@ -1126,7 +1126,7 @@ unsigned CPU::execute() {
     break;
   // Miscellaneous Instructions
   case 0x76: // HALT
-    halt = ime || (IF & IE & 0x1f) == 0;
+    halt = ime || mem.pending() == 0;
     break;
   case 0x10: // STOP
     stop = true;
@@ -45,7 +45,6 @@ private:
     uint16_t hl = 0x014d;
   };
   uint16_t sp = 0xfffe, pc = 0x0100;
-  uint8_t &IF = mem.refh(0x0f), &IE = mem.refh(0xff);
 
   // Arithmetic Functions
   uint8_t add(uint8_t a, uint8_t b);
@@ -0,0 +1,42 @@
+#ifndef FRONTEND_H
+#define FRONTEND_H
+
+#include "gameboy.h"
+
+// Shared Tables
+
+// DMG shades as 0xRRGGBB, lightest first
+const std::array<uint32_t, 4> shades = {0x9bbc0f, 0x8bac0f, 0x306230,
+                                        0x0f380f};
+
+// Input Types
+
+struct KeyEvent {
+  Input input;
+  bool down;
+};
+
+// Utility Functions
+
+inline std::array<uint32_t, 4> palette(bool bgr) {
+  // opaque 32-bit pixels, in ARGB or, for browser canvases, ABGR order
+  std::array<uint32_t, 4> colors;
+  for (unsigned i = 0; i < 4; ++i) {
+    uint32_t rgb = shades[i];
+    if (bgr)
+      rgb = ((rgb & 0xff) << 16) | (rgb & 0xff00) | (rgb >> 16);
+    colors[i] = 0xff000000 | rgb;
+  }
+  return colors;
+}
+
+template <typename Key>
+std::map<Key, Input> bind_keys(const std::array<Key, 8> &keys) {
+  // keys are given in Input order: a, b, select, start, right, left, up, down
+  std::map<Key, Input> bindings;
+  for (unsigned i = 0; i < keys.size(); ++i)
+    bindings[keys[i]] = static_cast<Input>(i);
+  return bindings;
+}
+
+#endif
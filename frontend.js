@@ -0,0 +1,94 @@
+// page code shared by both wasm builds, included ahead of script.js or
+// script_worker.js, which supply their own save, load, download and unlock
+
+var lastFilename = '';
+var uploads = new Map();
+
+// register offline service worker
+
+const registerWorker = () => {
+  if (!('serviceWorker' in navigator)) return;
+  window.addEventListener('load', () => {
+    navigator.serviceWorker.register('worker.js');
+  });
+};
+
+// setup file system
+
+const mountData = () => {
+  // load files from indexedDB
+  FS.mkdir('/data');
+  FS.mount(IDBFS, {}, '/data');
+  FS.syncfs(true, err => {
+    FS.currentPath = '/data';
+    if (!FS.analyzePath('filename.txt').exists) return;
+    lastFilename = FS.readFile('filename.txt', {encoding: 'utf8'});
+    document.getElementById('rom').labels[0].innerHTML = lastFilename + '.gb';
+    if (!FS.analyzePath('ram.sav').exists) return;
+    document.getElementById('ram').labels[0].innerHTML = lastFilename + '.sav';
+  });
+};
+
+// create event listeners
+
+const upload = (input, filename) => {
+  if (input.files.length == 0) return;
+  if (FS.analyzePath('ram.sav').exists || uploads.has('ram.sav')) {
+    FS.writeFile('ram.sav', '');
+    uploads.delete('ram.sav');
+    document.getElementById('ram').labels[0].innerHTML = 'Select Save';
+  }
+  const file = input.files[0];
+  let fr = new FileReader();
+  fr.readAsArrayBuffer(file);
+  fr.onload = () => {
+    const data = new Uint8Array(fr.result);
+    uploads.set(filename, data);
+    FS.writeFile(filename, data);
+  };
+  input.labels[0].innerHTML = file.name;
+  lastFilename = file.name.replace(/\.[^/.]+$/, '');
+  FS.writeFile('filename.txt', lastFilename);
+};
+
+const romError = () => {
+  document.getElementById('rom').labels[0].innerHTML = 'Invalid ROM';
+};
+
+const simulateKey = (type, code) => {
+  var event = new KeyboardEvent(type, {
+    'keyCode': code, 'charCode': code, 'view': window,
+    'bubbles': true, 'cancelable': true,
+  });
+  document.body.dispatchEvent(event);
+}
+
+// attach event listeners
+
+const attachControls = ({save, load, download, unlock}) => {
+  window.onbeforeunload = save;
+  document.addEventListener('visibilitychange', save);
+  document.getElementById('rom')
+    .addEventListener('change', e => upload(e.target, 'rom.gb'));
+  document.getElementById('ram')
+    .addEventListener('change', e => upload(e.target, 'ram.sav'));
+  document.getElementById('load')
+    .addEventListener('click', load);
+  document.getElementById('load')
+    .addEventListener('click', unlock);
+  document.getElementById('load')
+    .addEventListener('touchend', unlock);
+  document.getElementById('save')
+    .addEventListener('click', download);
+
+  const bindings = new Map([
+    ['select', 8], ['start', 13], ['a', 88], ['b', 90],
+    ['left', 37], ['right', 39], ['up', 38], ['down', 40]
+  ]);
+  bindings.forEach((code, id) => {
+    document.getElementById(id + '-btn')
+      .addEventListener('pointerenter', () => simulateKey('keydown', code));
+    document.getElementById(id + '-btn')
+      .addEventListener('pointerleave', () => simulateKey('keyup', code));
+  });
+};
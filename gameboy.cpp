@@ -2,23 +2,37 @@
 
 // Core Functions
 
-Gameboy::Gameboy(const std::string &filename, const std::string &save)
-    : mem(filename, save), cpu(mem), ppu(mem), apu(mem), timer(mem),
-      joypad(mem) {}
+Gameboy::Gameboy(const std::string &filename, const std::string &save,
+                 const AudioConfig &audio)
+    : mem(filename, save), cpu(mem), ppu(mem), apu(audio), timer(mem),
+      joypad(mem) {
+  mem.attach(timer, ppu, apu, joypad);
+}
+
+Gameboy::Gameboy(const uint8_t *rom, size_t rom_bytes, const uint8_t *save,
+                 size_t save_bytes, const AudioConfig &audio)
+    : mem(rom, rom_bytes, save, save_bytes), cpu(mem), ppu(mem), apu(audio),
+      timer(mem), joypad(mem) {
+  mem.attach(timer, ppu, apu, joypad);
+}
 
 void Gameboy::step() {
   joypad.update();
   unsigned cycles = cpu.execute();
+  mem.tick(cycles);
   timer.update(cycles);
   ppu.update(cycles);
-  apu.update(cycles);
+  apu.update(cycles, timer.get_div());
 }
 
-void Gameboy::update() {
+void Gameboy::update(bool render) {
+  uint64_t start = mem.tracer.now();
+  ppu.set_render(render);
   while (ppu.get_mode() == 1)
     step();
   while (ppu.get_mode() != 1)
     step();
+  mem.tracer.span("update", start);
 }
 
 void Gameboy::input(Input input_enum, bool val) {
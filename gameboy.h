@@ -17,18 +17,43 @@ struct Gameboy {
   Joypad joypad;
 
   // Core Functions
-  explicit Gameboy(const std::string &filename, const std::string &save);
+  Gameboy(const std::string &filename, const std::string &save,
+          const AudioConfig &audio = AudioConfig());
+  Gameboy(const uint8_t *rom, size_t rom_bytes, const uint8_t *save = nullptr,
+          size_t save_bytes = 0, const AudioConfig &audio = AudioConfig());
+  static bool valid_rom(const uint8_t *rom, size_t rom_bytes) {
+    return Memory::valid_rom(rom, rom_bytes);
+  }
+  static bool valid_rom(const std::string &filename) {
+    return Memory::valid_rom(filename);
+  }
   void step();
-  void update();
+  void update(bool render = true);
   void input(Input input_enum, bool val);
   const std::array<uint8_t, 160 * 144> &get_lcd() const {
     return ppu.get_lcd();
   }
-  const std::vector<int16_t> &read_audio() { return apu.read_audio(); }
-  void save(const std::string &save) { mem.save(save); }
+  size_t read_audio(int16_t *dst, size_t max_frames) {
+    return apu.read_audio(dst, max_frames);
+  }
+  void read_audio(AudioRing &ring) { apu.read_audio(ring); }
+  void set_audio(bool on) { apu.set_synth(on); }
+  bool record(const std::string &filename, bool stems = false) {
+    return apu.record(filename, stems);
+  }
+  void stop_recording() { apu.stop_recording(); }
+  bool save(const std::string &save, bool force = false) {
+    return mem.save(save, force);
+  }
+  size_t save(uint8_t *dst, size_t max_bytes) {
+    return mem.save(dst, max_bytes);
+  }
+  size_t save_size() const { return mem.save_size(); }
+  bool map_save(const std::string &save) { return mem.map_save(save); }
 
   // Debug Functions
   void print() const { cpu.print(); }
+  Tracer &get_tracer() { return mem.tracer; }
 };
 
 #endif
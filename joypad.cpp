@@ -2,10 +2,7 @@
 
 // Core Functions
 
-Joypad::Joypad(Memory &mem_in) : mem(mem_in) {
-  p1 = 0xcf;
-  mem.wmask(0xff00, 0x30);
-}
+Joypad::Joypad(Memory &mem_in) : mem(mem_in) {}
 
 void Joypad::update() {
   // set P1 using CPU output
@@ -14,7 +11,7 @@ void Joypad::update() {
   p1 = (p1 & 0xf0) | (read_buttons & read_directions & 0xf);
   // check joypad interrupt
   bool pressed = (read_buttons & read_directions) != 0xf;
-  if (!last_pressed && pressed) IF = write1(IF, 4, true);
+  if (!last_pressed && pressed) mem.request(4);
   last_pressed = pressed;
 }
 
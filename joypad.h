@@ -10,14 +10,20 @@ private:
   // Internal State
   Memory &mem;
   bool last_pressed = false;
-  uint8_t &IF = mem.refh(0x0f), &p1 = mem.refh(0x00);
   uint8_t buttons = 0xff, directions = 0xff;
 
+  // Registers
+  uint8_t p1 = 0xcf;
+
 public:
   // Core Functions
   explicit Joypad(Memory &mem_in);
   void update();
   void input(Input input_enum, bool val);
+
+  // I/O Functions
+  uint8_t read() const { return p1; }
+  void write(uint8_t val) { p1 = (val & 0x30) | (p1 & 0xcf); }
 };
 
 #endif
@@ -0,0 +1,12 @@
+// load the SIMD128 build when supported, each module with its own glue
+
+(() => {
+  const simd = WebAssembly.validate(new Uint8Array([
+    0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1,
+    8, 0, 65, 0, 253, 15, 253, 98, 11
+  ]));
+  const script = document.createElement('script');
+  script.src = simd ? 'index.simd.js' : 'index.js';
+  script.async = true;
+  document.body.appendChild(script);
+})();
@@ -1,73 +1,300 @@
-#include "gameboy.h"
+#include "frontend.h"
 #include <SDL2/SDL.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
 
 // Static Tables
 
-const std::array<uint32_t, 4> colors = {0xff9bbc0f, 0xff8bac0f, 0xff306230,
-                                        0xff0f380f};
-const std::map<SDL_Keycode, Input> bindings = {{SDLK_x, Input::a},
-                                               {SDLK_z, Input::b},
-                                               {SDLK_BACKSPACE, Input::select},
-                                               {SDLK_RETURN, Input::start},
-                                               {SDLK_RIGHT, Input::right},
-                                               {SDLK_LEFT, Input::left},
-                                               {SDLK_UP, Input::up},
-                                               {SDLK_DOWN, Input::down}};
+const std::array<uint32_t, 4> colors = palette(false);
+const std::map<SDL_Keycode, Input> bindings = bind_keys<SDL_Keycode>(
+    {{SDLK_x, SDLK_z, SDLK_BACKSPACE, SDLK_RETURN, SDLK_RIGHT, SDLK_LEFT,
+      SDLK_UP, SDLK_DOWN}});
+const double frame_time = 70224 / 4194304.0;
+
+// Frame Pacing
+
+enum class Pacing { timer, audio, none };
 
 // Global State
 
 Gameboy *gameboy;
+std::string rom_file, save_file;
+unsigned scale = 4;
+unsigned long frames_limit = 0;
+unsigned long frames_run = 0;
+bool headless = false;
+bool turbo = false;
+bool map_save = false;
 std::array<uint32_t, 160 * 144> pixels;
 SDL_Renderer *renderer;
 SDL_Window *window;
 SDL_Texture *texture;
 SDL_AudioDeviceID dev;
+AudioRing audio;
+AudioConfig audio_config;
+uint16_t audio_samples = 512;
+size_t audio_latency;
+Pacing pacing = Pacing::audio;
+bool vsync = false;
+const char *trace_file;
+
+// Thread State
+
+std::thread emulation;
+std::atomic<bool> running(true);
+TripleBuffer<std::array<uint8_t, 160 * 144>> frames;
+Ring<KeyEvent, 64> inputs;
+
+// Pacing Statistics
+
+std::atomic<unsigned> underruns(0);
+uint64_t last_present = 0;
+double frame_sum = 0, frame_sq = 0;
+unsigned frame_count = 0;
 
 // Core Functions
 
+void audio_callback(void *, uint8_t *out, int bytes) {
+  // copy audio buffer to SDL, silence on underrun
+  int16_t *samples = reinterpret_cast<int16_t *>(out);
+  size_t count = audio.pop(samples, bytes / 2);
+  std::fill_n(samples + count, bytes / 2 - count, 0);
+  if (count < static_cast<size_t>(bytes / 2)) ++underruns;
+}
+
+size_t audio_fill() {
+  return audio.size() / (audio_config.mono ? 1 : 2);
+}
+
+void emulate() {
+  // apply input forwarded from render thread
+  KeyEvent key;
+  while (inputs.pop(&key, 1) != 0)
+    gameboy->input(key.input, key.down);
+
+  // run one frame and publish it
+  gameboy->update();
+  frames.back() = gameboy->get_lcd();
+  frames.publish();
+  if (++frames_run % 60 == 0) gameboy->save(save_file);
+  Tracer &tracer = gameboy->get_tracer();
+  uint64_t start = tracer.now();
+  gameboy->read_audio(audio);
+  tracer.span("audio", start);
+}
+
+void run() {
+  double freq = SDL_GetPerformanceFrequency();
+  double next_frame = SDL_GetPerformanceCounter();
+  while (running) {
+    // sleep until audio drains to target, or until next DMG frame
+    double delay = 0;
+    if (pacing == Pacing::none) {
+      emulate();
+      continue;
+    } else if (pacing == Pacing::audio) {
+      size_t fill = audio_fill();
+      // always sleep when skipping a frame, or the thread spins
+      if (fill < audio_latency)
+        emulate();
+      else
+        delay = std::max(1.0, 1000.0 * (fill - audio_latency) /
+                                  audio_config.rate);
+    } else {
+      emulate();
+      next_frame += frame_time * freq;
+      double now = SDL_GetPerformanceCounter();
+      // after a stall, resume from now rather than bursting to catch up
+      if (now - next_frame > 4 * frame_time * freq) next_frame = now;
+      delay = (next_frame - now) * 1000.0 / freq;
+    }
+    if (delay >= 1) SDL_Delay(delay);
+  }
+}
+
+void report() {
+  // print mean frame time, jitter and underruns since last report
+  if (frame_count == 0) return;
+  double mean = frame_sum / frame_count;
+  double variance = frame_sq / frame_count - mean * mean;
+  double jitter = std::sqrt(std::max(0.0, variance));
+  printf("frame time %.2f ms, jitter %.2f ms, underruns %u\n", mean, jitter,
+         underruns.exchange(0));
+  frame_sum = frame_sq = 0;
+  frame_count = 0;
+}
+
+void measure() {
+  // accumulate interval between presented frames
+  uint64_t now = SDL_GetPerformanceCounter();
+  double ms = (now - last_present) * 1000.0 / SDL_GetPerformanceFrequency();
+  if (last_present != 0) {
+    frame_sum += ms;
+    frame_sq += ms * ms;
+    ++frame_count;
+  }
+  last_present = now;
+  if (frame_count >= 600) report();
+}
+
 void loop() {
-  if (gameboy == nullptr) return;
-  // handle keyboard input
+  // forward keyboard input to emulation thread
   SDL_Event event;
   while (SDL_PollEvent(&event) != 0) {
     if (event.type == SDL_QUIT) exit(0);
-    if (event.type == SDL_KEYDOWN) {
-      if (!bindings.count(event.key.keysym.sym)) continue;
-      gameboy->input(bindings.at(event.key.keysym.sym), true);
-    } else if (event.type == SDL_KEYUP) {
-      if (!bindings.count(event.key.keysym.sym)) continue;
-      gameboy->input(bindings.at(event.key.keysym.sym), false);
-    }
+    if (event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) continue;
+    if (!bindings.count(event.key.keysym.sym)) continue;
+    KeyEvent key = {bindings.at(event.key.keysym.sym),
+                    event.type == SDL_KEYDOWN};
+    inputs.push(&key, 1);
   }
 
-  // generate screen texture
-  const std::array<uint8_t, 160 * 144> &lcd = gameboy->get_lcd();
-  for (unsigned i = 0; i < 160 * 144; ++i)
-    pixels[i] = colors[lcd[i]];
+  // without vsync, only present when a new frame is ready
+  bool updated = frames.update();
+  if (!updated && !vsync) {
+    SDL_Delay(1);
+    return;
+  }
 
-  // draw screen texture
-  SDL_UpdateTexture(texture, nullptr, &pixels[0], 160 * 4);
+  // generate and draw screen texture from newest frame
+  if (updated) {
+    const std::array<uint8_t, 160 * 144> &lcd = frames.front();
+    for (unsigned i = 0; i < 160 * 144; ++i)
+      pixels[i] = colors[lcd[i]];
+    SDL_UpdateTexture(texture, nullptr, &pixels[0], 160 * 4);
+  }
   SDL_RenderCopy(renderer, texture, nullptr, nullptr);
   SDL_RenderPresent(renderer);
-
-  // queue audio buffer
-  gameboy->update();
-  const std::vector<int16_t> &audio = gameboy->read_audio();
-  SDL_QueueAudio(dev, audio.data(), 2 * audio.size());
+  measure();
 }
 
 void cleanup() {
+  running = false;
+  if (emulation.joinable()) emulation.join();
+  if (trace_file != nullptr) gameboy->get_tracer().write(trace_file);
+  report();
+  gameboy->save(save_file, true);
   delete gameboy;
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
-  SDL_CloseAudioDevice(dev);
+  if (dev != 0) SDL_CloseAudioDevice(dev);
   SDL_Quit();
 }
 
-int main() {
+void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options] rom [save]\n"
+          "  --scale N      window scale factor (default 4)\n"
+          "  --rate HZ      audio sample rate (default 44100)\n"
+          "  --mono         mix audio down to one channel\n"
+          "  --vsync        present frames in sync with the display\n"
+          "  --pacing MODE  pace emulation by 'audio' or 'timer' clock\n"
+          "  --turbo        run uncapped without audio, overrides --pacing\n"
+          "  --headless     run without SDL video or audio, print FPS\n"
+          "  --frames N     stop after N frames (headless only)\n"
+          "  --trace FILE   write Chrome trace of frame timeline at exit\n"
+          "  --mmap         map save file directly as cartridge ram\n",
+          name);
+  exit(1);
+}
+
+void parse(int argc, char **argv) {
+  // save path defaults to rom path with .sav extension
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (!strcmp(arg, "--scale") && has_value)
+      scale = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--rate") && has_value)
+      audio_config.rate = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--frames") && has_value)
+      frames_limit = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(arg, "--trace") && has_value)
+      trace_file = argv[++i];
+    else if (!strcmp(arg, "--pacing") && has_value) {
+      std::string mode = argv[++i];
+      if (mode != "audio" && mode != "timer") usage(argv[0]);
+      pacing = mode == "audio" ? Pacing::audio : Pacing::timer;
+    } else if (!strcmp(arg, "--mono"))
+      audio_config.mono = true;
+    else if (!strcmp(arg, "--vsync"))
+      vsync = true;
+    else if (!strcmp(arg, "--turbo"))
+      turbo = true;
+    else if (!strcmp(arg, "--headless"))
+      headless = true;
+    else if (!strcmp(arg, "--mmap"))
+      map_save = true;
+    else if (arg[0] == '-')
+      usage(argv[0]);
+    else
+      paths.push_back(arg);
+  }
+  if (paths.empty() || paths.size() > 2 || scale == 0) usage(argv[0]);
+  if (audio_config.rate < 22050 || audio_config.rate > 96000) usage(argv[0]);
+  // turbo wins over any pacing option, wherever it appears
+  if (turbo) pacing = Pacing::none;
+  rom_file = paths[0];
+  if (paths.size() == 2) {
+    save_file = paths[1];
+    return;
+  }
+  // only strip an extension within the file name itself
+  size_t dot = rom_file.rfind('.'), slash = rom_file.find_last_of("/\\");
+  bool ext = dot != std::string::npos &&
+             (slash == std::string::npos || dot > slash);
+  save_file = rom_file.substr(0, ext ? dot : std::string::npos) + ".sav";
+}
+
+int run_headless() {
+  // run frames back to back, nothing is ever presented or played
+  auto start = std::chrono::steady_clock::now();
+  unsigned long count = 0;
+  for (; frames_limit == 0 || count < frames_limit; ++count)
+    gameboy->update(false);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  double fps = count / elapsed.count();
+  printf("%lu frames in %.3f s, %.1f fps (%.2fx speed)\n", count,
+         elapsed.count(), fps, fps * frame_time);
+  if (trace_file != nullptr) gameboy->get_tracer().write(trace_file);
+  gameboy->save(save_file, true);
+  delete gameboy;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  parse(argc, argv);
+  FILE *file = fopen(rom_file.c_str(), "r");
+  if (file == nullptr) {
+    fprintf(stderr, "could not open %s\n", rom_file.c_str());
+    return 1;
+  }
+  fclose(file);
+  if (!Gameboy::valid_rom(rom_file)) {
+    fprintf(stderr, "%s is not a valid rom\n", rom_file.c_str());
+    return 1;
+  }
+
+  // create gameboy, audio is disabled in turbo and headless modes
+  gameboy = new Gameboy(rom_file, save_file, audio_config);
+  gameboy->set_audio(pacing != Pacing::none && !headless);
+  if (map_save && !gameboy->map_save(save_file))
+    fprintf(stderr, "could not map %s, saving normally\n", save_file.c_str());
+  if (trace_file != nullptr) gameboy->get_tracer().enable(1 << 16);
+  if (headless) return run_headless();
+
   // setup SDL video
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
-  SDL_CreateWindowAndRenderer(160 * 4, 144 * 4, 0, &window, &renderer);
+  window = SDL_CreateWindow("Frame Boy", SDL_WINDOWPOS_UNDEFINED,
+                            SDL_WINDOWPOS_UNDEFINED, 160 * scale, 144 * scale,
+                            0);
+  renderer = SDL_CreateRenderer(window, -1,
+                                vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
   SDL_SetRenderDrawColor(renderer, 0x9b, 0xbc, 0x0f, 0xff);
   SDL_RenderClear(renderer);
   texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
@@ -76,24 +303,30 @@ int main() {
   // setup SDL audio
   SDL_AudioSpec spec;
   SDL_zero(spec);
-  spec.freq = 44100;
+  spec.freq = audio_config.rate;
   spec.format = AUDIO_S16;
-  spec.channels = 2;
-  spec.samples = 512;
-  spec.callback = nullptr;
-  dev = SDL_OpenAudioDevice(nullptr, 0, &spec, nullptr, 0);
-  SDL_PauseAudioDevice(dev, 0);
+  spec.channels = audio_config.mono ? 1 : 2;
+  spec.samples = audio_samples;
+  audio_latency = audio_samples * 2;
+  spec.callback = audio_callback;
+  if (pacing != Pacing::none) {
+    dev = SDL_OpenAudioDevice(nullptr, 0, &spec, nullptr, 0);
+    if (dev != 0) SDL_PauseAudioDevice(dev, 0);
+  }
+
+  // nothing drains audio without a device, so pace by timer instead
+  if (dev == 0 && pacing == Pacing::audio) {
+    fprintf(stderr, "could not open audio device, pacing by timer\n");
+    pacing = Pacing::timer;
+    gameboy->set_audio(false);
+  }
 
   // call cleanup at exit
   atexit(cleanup);
 
-  // setup main loop
-  gameboy = new Gameboy("roms/zelda.gb", "roms/zelda.sav");
-  unsigned next_loop = SDL_GetTicks();
-  while (true) {
+  // setup main loop, rate control would fight audio pacing for the same fill
+  gameboy->apu.set_latency(pacing == Pacing::audio ? 0 : audio_latency);
+  emulation = std::thread(run);
+  while (true)
     loop();
-    next_loop += 16;
-    int delay = next_loop - SDL_GetTicks();
-    if (delay > 0) SDL_Delay(delay);
-  }
 }
@@ -1,37 +1,29 @@
-#include "gameboy.h"
+#include "frontend.h"
 #include <SDL/SDL.h>
 #include <emscripten.h>
 
 // Static Tables
 
-const std::array<uint32_t, 4> colors = {0xff0fbc9b, 0xff0fac8b, 0xff306230,
-                                        0xff0f380f};
-const std::map<SDL_Keycode, Input> bindings = {{SDLK_x, Input::a},
-                                               {SDLK_z, Input::b},
-                                               {SDLK_BACKSPACE, Input::select},
-                                               {SDLK_RETURN, Input::start},
-                                               {SDLK_RIGHT, Input::right},
-                                               {SDLK_LEFT, Input::left},
-                                               {SDLK_UP, Input::up},
-                                               {SDLK_DOWN, Input::down}};
+const std::array<uint32_t, 4> colors = palette(true);
+const std::map<SDL_Keycode, Input> bindings = bind_keys<SDL_Keycode>(
+    {{SDLK_x, SDLK_z, SDLK_BACKSPACE, SDLK_RETURN, SDLK_RIGHT, SDLK_LEFT,
+      SDLK_UP, SDLK_DOWN}});
 
 // Global State
 
 Gameboy *gameboy;
-std::vector<int16_t> audio;
+AudioRing audio;
+AudioConfig audio_config;
+uint16_t audio_samples = 1024;
 SDL_Surface *screen;
 
 // Core Functions
 
 void audio_callback([[maybe_unused]] void *args, uint8_t *out, int bytes) {
-  if (gameboy == nullptr) return;
-  // copy audio buffer to SDL
-  if (audio.size() < static_cast<size_t>(bytes / 2)) audio.resize(bytes / 2);
-  std::copy_n(&audio[0], bytes / 2, reinterpret_cast<uint16_t *>(out));
-
-  // move unused samples to front
-  std::vector<int16_t> temp(audio.begin() + bytes / 2, audio.end());
-  audio = std::move(temp);
+  // copy audio buffer to SDL, silence on underrun
+  int16_t *samples = reinterpret_cast<int16_t *>(out);
+  size_t count = audio.pop(samples, bytes / 2);
+  std::fill_n(samples + count, bytes / 2 - count, 0);
 }
 
 void loop() {
@@ -58,18 +50,37 @@ void loop() {
 
   // queue audio buffer
   gameboy->update();
-  const std::vector<int16_t> &frame_audio = gameboy->read_audio();
-  audio.insert(audio.end(), std::make_move_iterator(frame_audio.begin()),
-               std::make_move_iterator(frame_audio.end()));
+  gameboy->read_audio(audio);
 }
 
-extern "C" void save() {
-  gameboy->save("ram.sav");
+extern "C" bool save() {
+  return gameboy != nullptr && gameboy->save("ram.sav");
+}
+
+extern "C" bool load() {
+  if (!Gameboy::valid_rom("rom.gb")) return false;
+  delete gameboy;
+  gameboy = new Gameboy("rom.gb", "ram.sav", audio_config);
+  gameboy->apu.set_latency(audio_samples * 2);
+  return true;
 }
 
-extern "C" void load() {
+extern "C" bool load_data(const uint8_t *rom, size_t rom_bytes,
+                          const uint8_t *save, size_t save_bytes) {
+  // a bad rom leaves any running game in place
+  if (!Gameboy::valid_rom(rom, rom_bytes)) return false;
   delete gameboy;
-  gameboy = new Gameboy("rom.gb", "ram.sav");
+  gameboy = new Gameboy(rom, rom_bytes, save, save_bytes, audio_config);
+  gameboy->apu.set_latency(audio_samples * 2);
+  return true;
+}
+
+extern "C" size_t save_size() {
+  return gameboy == nullptr ? 0 : gameboy->save_size();
+}
+
+extern "C" size_t save_data(uint8_t *dst, size_t max_bytes) {
+  return gameboy == nullptr ? 0 : gameboy->save(dst, max_bytes);
 }
 
 extern "C" int main() {
@@ -80,10 +91,10 @@ extern "C" int main() {
   // setup SDL audio
   SDL_AudioSpec spec;
   memset(&spec, 0, sizeof(spec));
-  spec.freq = 44100;
+  spec.freq = audio_config.rate;
   spec.format = AUDIO_S16;
-  spec.channels = 2;
-  spec.samples = 1024;
+  spec.channels = audio_config.mono ? 1 : 2;
+  spec.samples = audio_samples;
   spec.callback = audio_callback;
 
   SDL_OpenAudio(&spec, nullptr);
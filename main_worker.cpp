@@ -0,0 +1,113 @@
+#include "frontend.h"
+#include <chrono>
+#include <emscripten.h>
+#include <emscripten/threading.h>
+#include <thread>
+
+// Static Tables
+
+const std::array<uint32_t, 4> colors = palette(true);
+// bindings are keyed by DOM keyCode
+const std::map<int, Input> bindings =
+    bind_keys<int>({{88, 90, 8, 13, 39, 37, 38, 40}});
+
+// Thread State
+
+typedef std::array<uint32_t, 160 * 144> Frame;
+
+// audio ring is read directly by the AudioWorklet, which relies on its layout
+static_assert(sizeof(AudioRing) == 128 + 2 * AudioRing::capacity(),
+              "audio ring must be head, tail, then sample data");
+
+// Global State
+
+Gameboy *gameboy;
+AudioRing audio;
+AudioConfig audio_config;
+size_t audio_latency = 2048;
+TripleBuffer<Frame> frames;
+Ring<KeyEvent, 64> inputs;
+std::atomic<bool> load_request(false), save_request(false),
+    force_save(false);
+
+// Core Functions
+
+void emulate() {
+  // apply input forwarded from main browser thread
+  KeyEvent key;
+  while (inputs.pop(&key, 1) != 0)
+    gameboy->input(key.input, key.down);
+
+  // run one frame and publish it
+  gameboy->update();
+  const std::array<uint8_t, 160 * 144> &lcd = gameboy->get_lcd();
+  Frame &pixels = frames.back();
+  for (unsigned i = 0; i < 160 * 144; ++i)
+    pixels[i] = colors[lcd[i]];
+  frames.publish();
+  gameboy->read_audio(audio);
+}
+
+void service() {
+  // file access is proxied to the main browser thread, so notify it when done
+  if (save_request.exchange(false) && gameboy != nullptr) {
+    bool written = gameboy->save("ram.sav", force_save.exchange(false));
+    MAIN_THREAD_ASYNC_EM_ASM({ Module.saved($0); }, written);
+  }
+  if (load_request.exchange(false)) {
+    bool valid = Gameboy::valid_rom("rom.gb");
+    MAIN_THREAD_ASYNC_EM_ASM({ Module.loaded($0); }, valid);
+    if (!valid) return;
+    delete gameboy;
+    gameboy = new Gameboy("rom.gb", "ram.sav", audio_config);
+    // already paced by audio consumption, so leave rate control off
+    gameboy->apu.set_latency(0);
+  }
+}
+
+// Main Thread Functions
+
+extern "C" void save(int force) {
+  // downloads force a write so the file carries a fresh rtc timestamp
+  if (force != 0) force_save = true;
+  save_request = true;
+}
+
+extern "C" void load() {
+  load_request = true;
+}
+
+extern "C" void key(int code, int down) {
+  if (!bindings.count(code)) return;
+  KeyEvent event = {bindings.at(code), down != 0};
+  inputs.push(&event, 1);
+}
+
+extern "C" const uint32_t *frame() {
+  // newest completed frame, or null if nothing new was published
+  return frames.update() ? &frames.front()[0] : nullptr;
+}
+
+extern "C" AudioRing *audio_ring() {
+  return &audio;
+}
+
+extern "C" unsigned audio_rate() {
+  return audio_config.rate;
+}
+
+extern "C" unsigned audio_channels() {
+  return audio_config.mono ? 1 : 2;
+}
+
+extern "C" int main() {
+  // runs on a worker thread, paced by AudioWorklet consumption
+  while (true) {
+    service();
+    size_t queued = audio.size() / audio_channels();
+    if (gameboy != nullptr && queued < audio_latency)
+      emulate();
+    else
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
@@ -1,7 +1,19 @@
 #include "memory.h"
+#include "apu.h"
+#include "joypad.h"
+#include "ppu.h"
+#include "timer.h"
 #include <algorithm>
+#include <ctime>
 #include <string>
 
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define FRAME_BOY_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 // Range Functions
 
 Range::Range(uint16_t addr) : start(addr), end(addr) {}
@@ -16,31 +28,68 @@ bool Range::operator==(const Range &r) const {
   return start >= r.start && end <= r.end;
 }
 
-// Core Functions
+// File Functions
 
-Memory::Memory(const std::string &filename, const std::string &save) {
-  // open rom file
+static std::vector<uint8_t> read_file(const std::string &filename) {
+  // missing files read as empty
+  std::vector<uint8_t> data;
   FILE *file = fopen(filename.c_str(), "r");
-  assert(file != nullptr);
+  if (file == nullptr) return data;
   fseek(file, 0, SEEK_END);
-  long size = ftell(file);
+  data.resize(ftell(file));
   fseek(file, 0, SEEK_SET);
+  fread(data.data(), 1, data.size(), file);
+  fclose(file);
+  return data;
+}
+
+// Core Functions
+
+bool Memory::valid_rom(const uint8_t *rom_data, size_t rom_bytes) {
+  // needs both fixed banks, and header sizes the tables below can index
+  if (rom_bytes < 0x8000) return false;
+  return rom_data[0x148] <= 8 && rom_data[0x149] < 6;
+}
+
+bool Memory::valid_rom(const std::string &filename) {
+  std::vector<uint8_t> data = read_file(filename);
+  return valid_rom(data.data(), data.size());
+}
 
-  // resize & read rom
-  rom.resize(size);
-  fread(&rom[0], 1, size, file);
+Memory::Memory(const std::string &filename, const std::string &save)
+    : Memory(read_file(filename), read_file(save)) {}
+
+Memory::Memory(const std::vector<uint8_t> &rom_data,
+               const std::vector<uint8_t> &save_data)
+    : Memory(rom_data.data(), rom_data.size(), save_data.data(),
+             save_data.size()) {}
+
+Memory::Memory(const uint8_t *rom_data, size_t rom_bytes,
+               const uint8_t *save_data, size_t save_bytes) {
+  // start with no masks, cartridge ram pages always take slow path
+  rmasks.fill(0xff), wmasks.fill(0xff);
+  page_rmasks.fill(0xff), page_wmasks.fill(0xff);
+  pages.fill(0);
+  for (unsigned page = 0; page < 0x100; ++page)
+    update_page(page);
+
+  // resize & copy rom
+  assert(valid_rom(rom_data, rom_bytes));
+  cart_type = rom_data[0x147];
+  rom_size = rom_data[0x148];
+  ram_size = rom_data[0x149];
+  rom.assign(rom_data, rom_data + rom_bytes);
   std::copy_n(&rom[0], 0x8000, &mem[0]);
   rom.resize(0x8000 << rom_size);
-  fclose(file);
 
-  // resize & read ram
+  // resize & copy ram, banks under 8KB stay in mem
   std::array<unsigned, 6> ram_sizes = {0, 2, 8, 32, 128, 64};
   ram.resize(ram_sizes[ram_size] << 10);
-  file = fopen(save.c_str(), "r");
-  if (file != nullptr) {
-    fread(&ram[0], 1, ram.size(), file);
-    std::copy_n(&ram[0], 0x2000, &mem[0xa000]);
-    fclose(file);
+  ram_base = ram.size() >= 0x2000 ? &ram[0] : nullptr;
+  ram_map = ram_base != nullptr ? ram_base : &mem[0xa000];
+  if (save_bytes != 0 && !ram.empty()) {
+    std::copy_n(save_data, std::min(save_bytes, ram.size()), &ram[0]);
+    if (ram_base == nullptr) std::copy_n(&ram[0], ram.size(), &mem[0xa000]);
   }
 
   // set r/w permission bitmasks
@@ -59,16 +108,93 @@ Memory::Memory(const std::string &filename, const std::string &save) {
   rumble = (type == Range(0x1c, 0x1e));
   if (mbc == 0) return;
 
-  hook(Range(0x0, 0x1fff), [&](uint8_t val) {
+  // rtc footer follows ram in save data
+  size_t ram_bytes = ram_base != nullptr ? ram.size() : 0;
+  if (clock && save_bytes >= ram_bytes + RTC::footer_size)
+    rtc.load(save_data + ram_bytes, cycles, ::time(nullptr));
+}
+
+Memory::~Memory() {
+#ifdef FRAME_BOY_MMAP
+  if (save_fd < 0) return;
+  munmap(ram_base, save_size());
+  close(save_fd);
+#endif
+}
+
+void Memory::rmask(Range addr, uint8_t mask) {
+  set_mask(rmasks, page_rmasks, fine_rmask, addr, mask);
+}
+
+void Memory::wmask(Range addr, uint8_t mask) {
+  set_mask(wmasks, page_wmasks, fine_wmask, addr, mask);
+}
+
+void Memory::mask(Range addr, uint8_t mask) {
+  rmask(addr, mask);
+  wmask(addr, mask);
+}
+
+void Memory::hook(Range addr, std::function<void(uint8_t)> hook) {
+  hooks[addr] = hook;
+  for (unsigned page = addr.get_start() >> 8; page <= addr.get_end() >> 8;
+       ++page)
+    pages[page] |= hooked, update_page(page);
+}
+
+void Memory::attach(Timer &timer_in, PPU &ppu_in, APU &apu_in,
+                    Joypad &joypad_in) {
+  timer = &timer_in, ppu = &ppu_in, apu = &apu_in, joypad = &joypad_in;
+}
+
+void Memory::set_mask(std::array<uint8_t, 0x10000> &masks,
+                      std::array<uint8_t, 0x100> &page_masks, uint8_t fine,
+                      Range addr, uint8_t mask) {
+  unsigned start = addr.get_start(), end = addr.get_end();
+  for (unsigned page = start >> 8; page <= end >> 8; ++page) {
+    unsigned first = std::max(start, page << 8);
+    unsigned last = std::min(end, (page << 8) | 0xff);
+    if (first == page << 8 && last == ((page << 8) | 0xff)) {
+      // whole page shares one mask
+      page_masks[page] = mask;
+      pages[page] &= ~fine;
+    } else {
+      // partial page falls back to per-address masks
+      if (!(pages[page] & fine))
+        std::fill_n(&masks[page << 8], 0x100, page_masks[page]);
+      std::fill(&masks[first], &masks[last] + 1, mask);
+      pages[page] |= fine;
+    }
+    update_page(page);
+  }
+}
+
+void Memory::update_page(unsigned page) {
+  // any mask, hook, device or banked ram forces the out of line path
+  bool ram = (page >> 5) == 0x5;
+  bool device = page < 0x80 || page == 0xff;
+  bool rslow = ram || page == 0xff ||
+               (pages[page] & (fine_rmask | dma_lock)) ||
+               page_rmasks[page] != 0xff;
+  bool wslow = ram || device ||
+               (pages[page] & (fine_wmask | hooked | dma_lock)) ||
+               page_wmasks[page] != 0xff;
+  pages[page] &= ~(slow_read | slow_write);
+  pages[page] |= (rslow ? slow_read : 0) | (wslow ? slow_write : 0);
+}
+
+void Memory::write_mbc(uint16_t addr, uint8_t val) {
+  switch (addr >> 13) {
+  case 0: // ram enable
     if ((val & 0xf) == 0xa) {
-      if (ram.size() >= 0x2000)
+      if (ram.size() >= 0x2000 || clock)
         mask(Range(0xa000, 0xbfff), 0xff);
       else
         mask(Range(0xa000, 0xa000 + ram.size() - 1), 0xff);
     } else
       mask(Range(0xa000, 0xbfff), 0x0);
-  });
-  hook(Range(0x2000, 0x3fff), [&](uint8_t val) {
+    return;
+  case 1: // rom bank
     if (mbc == 1)
       val &= 0x1f;
     else if (mbc == 3)
@@ -76,103 +202,235 @@ Memory::Memory(const std::string &filename, const std::string &save) {
     if (val == 0) val = 1;
     if (mbc == 1) {
       bank = (bank & 0x60) | val;
-      if (ram_mode)
-        swap_rom(bank & 0x1f), swap_ram(bank >> 5);
-      else
-        swap_rom(bank), swap_ram(0);
-    } else
-      swap_rom(val);
-  });
-  hook(Range(0x4000, 0x5fff), [&](uint8_t val) {
+      break;
+    }
+    swap_rom(val);
+    return;
+  case 2: // ram bank or upper rom bank
     if (mbc == 1) {
       val &= 0x3;
       bank = (val << 5) | (bank & 0x1f);
-      if (ram_mode)
-        swap_rom(bank & 0x1f), swap_ram(bank >> 5);
-      else
-        swap_rom(bank), swap_ram(0);
-    } else {
-      if (rumble) val &= 0x7;
-      swap_ram(val);
+      break;
     }
-  });
-  hook(Range(0x6000, 0x7fff), [&](uint8_t val) {
+    // mbc3 banks 0x8-0xc select rtc registers instead of ram
+    if (rumble) val &= 0x7;
+    rtc_reg = (clock && val >= 0x8 && val <= 0xc) ? val : 0;
+    if (rtc_reg == 0) swap_ram(val);
+    return;
+  case 3: // banking mode or rtc latch
     if (mbc == 1) {
       ram_mode = read1(val, 0);
-      if (ram_mode)
-        swap_rom(bank & 0x1f), swap_ram(bank >> 5);
-      else
-        swap_rom(bank), swap_ram(0);
+      break;
     }
-  });
-}
-
-void Memory::rmask(Range addr, uint8_t mask) {
-  rmasks[addr] = mask;
-}
-
-void Memory::wmask(Range addr, uint8_t mask) {
-  wmasks[addr] = mask;
+    if (clock) {
+      rtc.latch(val, cycles);
+      ram_dirty = true;
+    }
+    return;
+  }
+  // mbc1 remaps both rom and ram on any banking write
+  if (ram_mode)
+    swap_rom(bank & 0x1f), swap_ram(bank >> 5);
+  else
+    swap_rom(bank), swap_ram(0);
 }
 
-void Memory::mask(Range addr, uint8_t mask) {
-  rmask(addr, mask);
-  wmask(addr, mask);
+uint8_t Memory::read_io(uint8_t reg) const {
+  // registers owned by devices, anything else reads back from mem
+  if (timer == nullptr) return mem[0xff00 + reg];
+  switch (reg) {
+  case 0x00:
+    return joypad->read();
+  case 0x04:
+  case 0x05:
+  case 0x06:
+  case 0x07:
+    return timer->read(reg);
+  case 0x0f:
+    return IF;
+  case 0xff:
+    return IE;
+  default:
+    if (reg >= 0x10 && reg < 0x40) return apu->read(reg);
+    if (reg >= 0x40 && reg < 0x4c) return ppu->read(reg);
+    return mem[0xff00 + reg];
+  }
 }
 
-void Memory::hook(Range addr, std::function<void(uint8_t)> hook) {
-  hooks[addr] = hook;
+bool Memory::write_io(uint8_t reg, uint8_t val) {
+  // statically dispatch to owning device, false if register lives in mem
+  if (timer == nullptr) return false;
+  switch (reg) {
+  case 0x00:
+    joypad->write(val);
+    return true;
+  case 0x04:
+  case 0x05:
+  case 0x06:
+  case 0x07:
+    timer->write(reg, val);
+    return true;
+  case 0x0f:
+    IF = val;
+    return true;
+  case 0xff:
+    IE = val;
+    return true;
+  default:
+    if (reg >= 0x10 && reg < 0x40)
+      apu->write(reg, val);
+    else if (reg >= 0x40 && reg < 0x4c)
+      ppu->write(reg, val);
+    else
+      return false;
+    return true;
+  }
 }
 
 void Memory::swap_rom(unsigned bank) {
   bank &= (0x2 << rom_size) - 1;
+  tracer.instant("rom bank");
   std::copy_n(&rom[bank * 0x4000], 0x4000, &mem[0x4000]);
 }
 
 void Memory::swap_ram(unsigned bank) {
   bank &= (ram.size() >> 13) - 1;
   if (bank == ram_bank || ram.size() <= 0x2000) return;
-  std::copy_n(&mem[0xa000], 0x2000, &ram[ram_bank * 0x2000]);
-  std::copy_n(&ram[bank * 0x2000], 0x2000, &mem[0xa000]);
+  tracer.instant("ram bank");
+  ram_map = ram_base + bank * 0x2000;
   ram_bank = bank;
 }
 
-void Memory::save(const std::string &save) {
-  FILE *file = fopen(save.c_str(), "w");
-  if (file == nullptr || ram.size() < 0x2000) return;
-  std::copy_n(&mem[0xa000], 0x2000, &ram[ram_bank * 0x2000]);
-  fwrite(&ram[0], 1, ram.size(), file);
-  fclose(file);
+bool Memory::save(const std::string &save, bool force) {
+  // carts without saved ram must never replace a file with nothing
+  if (save_size() == 0) return false;
+  // only queue a write if ram changed or the last write failed, unless
+  // forced to refresh the rtc timestamp on exit
+  if (saver.take_failure()) ram_dirty = true;
+  if (!ram_dirty && !force) return false;
+#ifdef FRAME_BOY_MMAP
+  // mapped saves only need rtc footer and writeback scheduled
+  if (save_fd >= 0) {
+    if (clock) rtc.save(ram_base + ram.size(), cycles, ::time(nullptr));
+    ram_dirty = msync(ram_base, save_size(), MS_ASYNC) != 0;
+    return !ram_dirty;
+  }
+#endif
+  std::vector<uint8_t> data(save_size());
+  size_t size = this->save(data.data(), data.size());
+  saver.write(save, data.data(), size);
+  // synchronous writes fail here, background ones on the next call
+  ram_dirty = saver.take_failure();
+  return !ram_dirty;
 }
 
-// Memory Access Functions
+bool Memory::map_save(const std::string &save) {
+#ifdef FRAME_BOY_MMAP
+  // map save file as ram backing store, sized to match cartridge ram
+  if (ram_base == nullptr || save_fd >= 0) return false;
+  int fd = open(save.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return false;
+  void *addr = MAP_FAILED;
+  size_t size = save_size();
+  if (ftruncate(fd, size) == 0)
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
 
-uint8_t Memory::read(uint16_t addr) const {
-  if (!rmasks.count(addr)) return mem[addr];
-  return mem[addr] | ~rmasks.at(addr);
+  // carry over loaded contents, then point banks into the file
+  ram_base = static_cast<uint8_t *>(addr);
+  std::copy(ram.begin(), ram.end(), ram_base);
+  if (clock) rtc.save(ram_base + ram.size(), cycles, ::time(nullptr));
+  ram_map = ram_base + ram_bank * 0x2000;
+  save_fd = fd;
+  return true;
+#else
+  return false;
+#endif
 }
 
-uint8_t Memory::readh(uint8_t addr) const {
-  return read(0xff00 + addr);
+size_t Memory::save(uint8_t *dst, size_t max_bytes) {
+  size_t size = save_size();
+  if (size == 0 || max_bytes < size) return 0;
+  size_t ram_bytes = ram_base != nullptr ? ram.size() : 0;
+  std::copy_n(ram_base, ram_bytes, dst);
+  if (clock) rtc.save(dst + ram_bytes, cycles, ::time(nullptr));
+  return size;
 }
 
-uint16_t Memory::read16(uint16_t addr) const {
-  return (read(addr + 1) << 8) | read(addr);
+size_t Memory::save_size() const {
+  // ram under 8KB is never saved
+  size_t ram_bytes = ram_base != nullptr ? ram.size() : 0;
+  return ram_bytes + (clock ? RTC::footer_size : 0);
 }
 
-void Memory::write(uint16_t addr, uint8_t val) {
-  if (hooks.count(addr)) hooks[addr](val);
-  if (!wmasks.count(addr))
-    mem[addr] = val;
-  else
-    mem[addr] = (val & wmasks.at(addr)) | (mem[addr] & ~wmasks.at(addr));
+// DMA Functions
+
+void Memory::start_dma(uint8_t src) {
+  // only record start, bytes are copied when observed or once finished
+  tracer.instant("dma");
+  dma_src = src << 8;
+  dma_copied = 0;
+  dma_end = cycles + 161;
+  // cpu only reaches hram while dma owns the bus
+  for (unsigned page = 0; page < 0xff; ++page)
+    pages[page] |= dma_lock, update_page(page);
+}
+
+void Memory::sync_dma() {
+  // one setup cycle, then one byte per cycle
+  if (dma_end == 0) return;
+  uint64_t elapsed = cycles + 160 > dma_end ? cycles + 160 - dma_end : 0;
+  unsigned progress = std::min<uint64_t>(elapsed, 160);
+  if (progress <= dma_copied) return;
+  // source never crosses a region, so copy straight from its backing store
+  const uint8_t *src = &ref(dma_src);
+  std::copy(src + dma_copied, src + progress, &mem[0xfe00 + dma_copied]);
+  dma_copied = progress;
 }
 
-void Memory::writeh(uint8_t addr, uint8_t val) {
-  write(0xff00 + addr, val);
+void Memory::finish_dma() {
+  sync_dma();
+  dma_end = 0;
+  for (unsigned page = 0; page < 0xff; ++page)
+    pages[page] &= ~dma_lock, update_page(page);
 }
 
-void Memory::write16(uint16_t addr, uint16_t val) {
-  write(addr + 1, val >> 8);
-  write(addr, val & 0xff);
+// Memory Access Functions
+
+uint8_t Memory::read_slow(uint16_t addr) const {
+  if (dma_end != 0 && addr < 0xff80) return 0xff;
+  uint8_t val = mem[addr];
+  if (addr >= 0xff00)
+    val = read_io(addr & 0xff);
+  else if ((addr >> 13) == 0x5)
+    val = rtc_reg != 0 ? rtc.read(rtc_reg) : ram_map[addr & 0x1fff];
+  return val | ~rmask_at(addr);
+}
+
+void Memory::write_slow(uint16_t addr, uint8_t val) {
+  if (dma_end != 0 && addr < 0xff80) return;
+  bool owned = false;
+  if (addr >= 0xff00)
+    owned = write_io(addr & 0xff, val);
+  else if (addr < 0x8000 && mbc != 0)
+    write_mbc(addr, val);
+  // hooks remain as extension points beyond built-in devices
+  if (!hooks.empty() && hooks.count(addr)) hooks[addr](val);
+  if (owned) return;
+  uint8_t mask = wmask_at(addr);
+  if ((addr >> 13) == 0x5 && rtc_reg != 0) {
+    // rtc registers follow the same enable mask as ram
+    if (mask != 0) {
+      rtc.write(rtc_reg, val, cycles);
+      ram_dirty = true;
+    }
+    return;
+  }
+  uint8_t &cell = ref(addr);
+  uint8_t old = cell;
+  cell = (val & mask) | (cell & ~mask);
+  if ((addr >> 13) == 0x5 && cell != old) ram_dirty = true;
 }
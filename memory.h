@@ -1,12 +1,26 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
+#include "rtc.h"
+#include "save.h"
+#include "trace.h"
 #include <array>
 #include <functional>
 #include <map>
 #include <string>
 #include <vector>
 
+#if defined(__GNUC__) || defined(__clang__)
+#define FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define FORCE_INLINE inline
+#endif
+
+class APU;
+class Joypad;
+class PPU;
+class Timer;
+
 class Range {
 private:
   // Internal State
@@ -18,19 +32,25 @@ public:
   Range(uint16_t start, uint16_t end);
   bool operator<(const Range &r) const;
   bool operator==(const Range &r) const;
+  uint16_t get_start() const { return start; }
+  uint16_t get_end() const { return end; }
 };
 
 class Memory {
 private:
   // Internal State
   std::vector<uint8_t> rom, ram;
+  uint8_t *ram_base = nullptr, *ram_map = nullptr;
+  int save_fd = -1;
   std::array<uint8_t, 0x10000> mem;
-  std::map<Range, uint8_t> rmasks, wmasks;
+  std::array<uint8_t, 0x10000> rmasks, wmasks;
+  std::array<uint8_t, 0x100> page_rmasks, page_wmasks, pages;
   std::map<Range, std::function<void(uint8_t)>> hooks;
-  uint8_t &cart_type = ref(0x147);
-  uint8_t &rom_size = ref(0x148);
-  uint8_t &ram_size = ref(0x149);
+  uint8_t cart_type = 0, rom_size = 0, ram_size = 0;
   unsigned ram_bank = 0;
+  uint64_t cycles = 0;
+  bool ram_dirty = false;
+  SaveWriter saver;
 
   // MBC State
   uint8_t mbc = 0;
@@ -38,28 +58,114 @@ private:
   bool rumble = false;
   bool ram_mode = false;
   unsigned bank = 0;
+  uint8_t rtc_reg = 0;
+  RTC rtc;
   void swap_rom(unsigned bank);
   void swap_ram(unsigned bank);
+  void write_mbc(uint16_t addr, uint8_t val);
+
+  // Interrupt Registers
+  uint8_t IF = 0xe1, IE = 0x0;
+
+  // DMA State
+  uint16_t dma_src = 0;
+  unsigned dma_copied = 0;
+  uint64_t dma_end = 0;
+  void finish_dma();
+
+  // I/O Devices
+  Timer *timer = nullptr;
+  PPU *ppu = nullptr;
+  APU *apu = nullptr;
+  Joypad *joypad = nullptr;
+  uint8_t read_io(uint8_t reg) const;
+  bool write_io(uint8_t reg, uint8_t val);
+
+  // Page Flags
+  static const uint8_t slow_read = 0x1, slow_write = 0x2;
+  static const uint8_t fine_rmask = 0x4, fine_wmask = 0x8, hooked = 0x10;
+  static const uint8_t dma_lock = 0x20;
+  void set_mask(std::array<uint8_t, 0x10000> &masks,
+                std::array<uint8_t, 0x100> &page_masks, uint8_t fine,
+                Range addr, uint8_t mask);
+  void update_page(unsigned page);
+  uint8_t rmask_at(uint16_t addr) const {
+    return pages[addr >> 8] & fine_rmask ? rmasks[addr]
+                                         : page_rmasks[addr >> 8];
+  }
+  uint8_t wmask_at(uint16_t addr) const {
+    return pages[addr >> 8] & fine_wmask ? wmasks[addr]
+                                         : page_wmasks[addr >> 8];
+  }
+  uint8_t read_slow(uint16_t addr) const;
+  void write_slow(uint16_t addr, uint8_t val);
+  explicit Memory(const std::vector<uint8_t> &rom_data,
+                  const std::vector<uint8_t> &save_data);
 
 public:
+  // Debug State
+  Tracer tracer;
+
   // Core Functions
   explicit Memory(const std::string &filename, const std::string &save);
+  explicit Memory(const uint8_t *rom_data, size_t rom_bytes,
+                  const uint8_t *save_data, size_t save_bytes);
+  ~Memory();
+  static bool valid_rom(const uint8_t *rom_data, size_t rom_bytes);
+  static bool valid_rom(const std::string &filename);
+  // owns mapped save and raw bank pointers into its own buffers
+  Memory(const Memory &) = delete;
+  Memory &operator=(const Memory &) = delete;
   void rmask(Range addr, uint8_t mask);
   void wmask(Range addr, uint8_t mask);
   void mask(Range addr, uint8_t mask);
   void hook(Range addr, std::function<void(uint8_t)> hook);
-  void save(const std::string &save);
+  void attach(Timer &timer_in, PPU &ppu_in, APU &apu_in, Joypad &joypad_in);
+  bool save(const std::string &save, bool force = false);
+  bool map_save(const std::string &save);
+  size_t save(uint8_t *dst, size_t max_bytes);
+  size_t save_size() const;
+  void tick(unsigned cpu_cycles) {
+    cycles += cpu_cycles;
+    tracer.tick(cpu_cycles);
+    if (dma_end != 0 && cycles >= dma_end) finish_dma();
+  }
+  uint64_t get_cycles() const { return cycles; }
+
+  // Interrupt Functions
+  void request(unsigned bit) { IF |= 0x1 << bit; }
+  void acknowledge(unsigned bit) { IF &= ~(0x1 << bit); }
+  uint8_t pending() const { return IF & IE & 0x1f; }
+
+  // DMA Functions
+  void start_dma(uint8_t src);
+  void sync_dma();
 
   // Memory Access Functions
-  uint8_t &ref(uint16_t addr) { return mem[addr]; }
-  uint8_t &refh(uint8_t addr) { return ref(0xff00 + addr); }
-  uint8_t read(uint16_t addr) const;
-  uint8_t readh(uint8_t addr) const;
-  uint16_t read16(uint16_t addr) const;
+  uint8_t &ref(uint16_t addr) {
+    return (addr >> 13) == 0x5 ? ram_map[addr & 0x1fff] : mem[addr];
+  }
+  FORCE_INLINE uint8_t read(uint16_t addr) const {
+    // plain pages skip masks, hooks and banking
+    if (!(pages[addr >> 8] & slow_read)) return mem[addr];
+    return read_slow(addr);
+  }
+  uint8_t readh(uint8_t addr) const { return read(0xff00 + addr); }
+  uint16_t read16(uint16_t addr) const {
+    return (read(addr + 1) << 8) | read(addr);
+  }
   uint16_t read16h(uint8_t addr) const;
-  void write(uint16_t addr, uint8_t val);
-  void writeh(uint8_t addr, uint8_t val);
-  void write16(uint16_t addr, uint16_t val);
+  FORCE_INLINE void write(uint16_t addr, uint8_t val) {
+    if (!(pages[addr >> 8] & slow_write))
+      mem[addr] = val;
+    else
+      write_slow(addr, val);
+  }
+  void writeh(uint8_t addr, uint8_t val) { write(0xff00 + addr, val); }
+  void write16(uint16_t addr, uint16_t val) {
+    write(addr + 1, val >> 8);
+    write(addr, val & 0xff);
+  }
   void write16h(uint8_t addr, uint16_t val);
 };
 
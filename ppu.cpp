@@ -16,6 +16,8 @@ bool Sprite::operator<(const Sprite &r) const {
 void PPU::get_sprites() {
   sprites.clear();
   if (!read1(lcdc, 1)) return;
+  // bring OAM up to date with any transfer in progress
+  mem.sync_dma();
   unsigned height = 8 + (read1(lcdc, 2) << 3);
   // fetch sprites from OAM RAM
   for (uint16_t i = 0xfe00; i < 0xfe9f; i += 4) {
@@ -82,49 +84,26 @@ void PPU::draw() {
   for (uint16_t i = 0, j = ly * 160 + x; i < 4; ++i, ++j) {
     lcd[j] = (palettes[i] >> (pixels[i] << 1)) & 0x3;
   }
-  x += 4;
 }
 
-void PPU::check_lyc() const {
+void PPU::check_lyc() {
   bool lyc_equal = lyc == ly;
   stat = write1(stat, 2, lyc_equal);
-  if (read1(stat, 6) && lyc_equal) IF = write1(IF, 1, true);
+  if (read1(stat, 6) && lyc_equal) stat_interrupt();
+}
+
+void PPU::stat_interrupt() const {
+  mem.request(1);
+  mem.tracer.instant("stat irq");
 }
 
 // Core Functions
 
 PPU::PPU(Memory &mem_in) : mem(mem_in) {
-  // set initial register values
-  lcdc = 0x91, stat = 0x81;
-  ly = 0x8f, bgp = 0xfc;
-  IF = 0xe1;
   lcd.fill(0x0);
-  // set r/w permission bitmasks
-  mem.wmask(0xff41, 0x78);
-  mem.wmask(0xff44, 0x0);
-  mem.rmask(0xff46, 0x0);
-  // create on-write hooks
-  mem.hook(0xff46, [&](uint8_t val) {
-    dma_src = (val << 8) - 1;
-    dma_i = 0;
-  });
-  mem.hook(0xff45, [&](uint8_t val) {
-    stat = write1(stat, 2, ly == val);
-    if (read1(stat, 6) && ly == val) IF = write1(IF, 1, true);
-  });
-  mem.hook(0xff40, [&](uint8_t val) {
-    bg_tiles = read1(val, 4) ? 0x8000 : 0x8800;
-    bg_map = read1(val, 3) ? 0x9c00 : 0x9800;
-    win_map = read1(val, 6) ? 0x9c00 : 0x9800;
-    height16 = read1(val, 2);
-  });
 }
 
 void PPU::update(unsigned cpu_cycles) {
-  // handle DMA OAM copy
-  for (unsigned i = 0; dma_i < 161 && i < cpu_cycles; ++i, ++dma_i) {
-    if (dma_i != 0) mem.ref(0xfdff + dma_i) = mem.ref(dma_src + dma_i);
-  }
   // change mode & draw lcd
   if (read1(lcdc, 7)) {
     for (unsigned i = 0; i < cpu_cycles; ++i, ++cycles) {
@@ -134,31 +113,38 @@ void PPU::update(unsigned cpu_cycles) {
         cycles = 0, ++ly, check_lyc();
         mode = (ly == 144 ? 1 : 2);
         if (mode == 2) mem.mask(Range(0xfe00, 0xfe9f), 0x0);
-        if (read1(stat, 3 + mode)) IF = write1(IF, 1, true);
+        if (read1(stat, 3 + mode)) stat_interrupt();
         stat = (stat & 0xfc) | mode;
         continue;
       }
       case 1: // V-BLANK
-        if (ly == 144 && cycles == 4) IF = write1(IF, 0, true);
+        if (ly == 144 && cycles == 4) {
+          mem.request(0);
+          mem.tracer.instant("vblank");
+        }
         if (cycles != 113) continue;
         if (ly == 154) {
           ly = -1, mode = 2;
           stat = (stat & 0xfc) | 2;
-          if (read1(stat, 5)) IF = write1(IF, 1, true);
+          if (read1(stat, 5)) stat_interrupt();
         }
         cycles = 0, ++ly, check_lyc();
         continue;
       case 2: // Using OAM
         if (cycles != 19) continue;
         cycles = x = 0;
-        get_sprites();
+        if (render) get_sprites();
         mem.mask(Range(0x8000, 0x9fff), 0x0);
         stat = (stat & 0xfc) | 3, mode = 3;
         continue;
       case 3: // Using VRAM
-        if (cycles >= 3) draw();
+        // skip pixel generation when frame is not rendered
+        if (cycles >= 3) {
+          if (render) draw();
+          x += 4;
+        }
         if (x != 160) continue;
-        if (read1(stat, 3)) IF = write1(IF, 1, true);
+        if (read1(stat, 3)) stat_interrupt();
         mem.mask(Range(0xfe00, 0xfe9f), 0xff);
         mem.mask(Range(0x8000, 0x9fff), 0xff);
         stat = stat & 0xfc, mode = 0;
@@ -172,3 +158,53 @@ void PPU::update(unsigned cpu_cycles) {
     stat = stat & 0xfc, mode = 0;
   }
 }
+
+// I/O Functions
+
+uint8_t PPU::read(uint8_t reg) const {
+  switch (reg) {
+  case 0x40: return lcdc;
+  case 0x41: return stat;
+  case 0x42: return scy;
+  case 0x43: return scx;
+  case 0x44: return ly;
+  case 0x45: return lyc;
+  case 0x47: return bgp;
+  case 0x48: return obp0;
+  case 0x49: return obp1;
+  case 0x4a: return wy;
+  case 0x4b: return wx;
+  default: return 0xff; // DMA is write only
+  }
+}
+
+void PPU::write(uint8_t reg, uint8_t val) {
+  switch (reg) {
+  case 0x40:
+    lcdc = val;
+    bg_tiles = read1(val, 4) ? 0x8000 : 0x8800;
+    bg_map = read1(val, 3) ? 0x9c00 : 0x9800;
+    win_map = read1(val, 6) ? 0x9c00 : 0x9800;
+    height16 = read1(val, 2);
+    break;
+  case 0x41: // only interrupt selects are writable
+    stat = (val & 0x78) | (stat & 0x87);
+    break;
+  case 0x42: scy = val; break;
+  case 0x43: scx = val; break;
+  case 0x44: break; // LY is read only
+  case 0x45:
+    stat = write1(stat, 2, ly == val);
+    if (read1(stat, 6) && ly == val) stat_interrupt();
+    lyc = val;
+    break;
+  case 0x46:
+    mem.start_dma(val);
+    break;
+  case 0x47: bgp = val; break;
+  case 0x48: obp0 = val; break;
+  case 0x49: obp1 = val; break;
+  case 0x4a: wy = val; break;
+  case 0x4b: wx = val; break;
+  }
+}
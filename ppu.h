@@ -24,8 +24,8 @@ private:
   std::array<uint8_t, 4> pixels;
   std::array<uint8_t, 4> palettes;
   std::array<uint8_t, 160 * 144> lcd;
-  unsigned cycles = 0, dma_i = 161;
-  uint16_t x = 0, dma_src = 0;
+  unsigned cycles = 0;
+  uint16_t x = 0;
 
   // Cached Properties
   uint16_t bg_tiles = 0x8000;
@@ -33,28 +33,31 @@ private:
   uint16_t win_map = 0x9800;
   uint8_t mode = 0;
   bool height16 = false;
+  bool render = true;
 
   // Registers
-  uint8_t &lcdc = mem.refh(0x40), &stat = mem.refh(0x41);
-  uint8_t &scy = mem.refh(0x42), &scx = mem.refh(0x43);
-  uint8_t &ly = mem.refh(0x44), &lyc = mem.refh(0x45);
-  uint8_t &bgp = mem.refh(0x47), &obp0 = mem.refh(0x48);
-  uint8_t &obp1 = mem.refh(0x49), &wy = mem.refh(0x4a);
-  uint8_t &wx = mem.refh(0x4b), &IF = mem.refh(0x0f);
+  uint8_t lcdc = 0x91, stat = 0x81, scy = 0, scx = 0, ly = 0x8f, lyc = 0;
+  uint8_t bgp = 0xfc, obp0 = 0, obp1 = 0, wy = 0, wx = 0;
 
   // Drawing Functions
   void get_sprites();
   void draw_sprite(const Sprite &sprite);
   void draw_tile(uint16_t map, uint8_t x, uint8_t y, unsigned i);
   void draw();
-  void check_lyc() const;
+  void check_lyc();
+  void stat_interrupt() const;
 
 public:
   // Core Functions
   explicit PPU(Memory &mem_in);
   void update(unsigned cpu_cycles);
+  void set_render(bool on) { render = on; }
   uint8_t get_mode() const { return stat & 0x3; }
   const std::array<uint8_t, 160 * 144> &get_lcd() const { return lcd; }
+
+  // I/O Functions
+  uint8_t read(uint8_t reg) const;
+  void write(uint8_t reg, uint8_t val);
 };
 
 #endif
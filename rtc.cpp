@@ -0,0 +1,94 @@
+#include "rtc.h"
+
+// Static Tables
+
+// keep only the implemented bits of S/M/H/DL/DH
+const std::array<uint8_t, 5> RTC::masks = {{0x3f, 0x3f, 0x1f, 0xff, 0xc1}};
+
+// Utility Functions
+
+static void put32(uint8_t *out, uint32_t val) {
+  for (unsigned i = 0; i < 4; ++i)
+    out[i] = (val >> (i * 8)) & 0xff;
+}
+
+static uint32_t get32(const uint8_t *in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) | (uint32_t(in[3]) << 24);
+}
+
+// Core Functions
+
+uint64_t RTC::time(uint64_t cycles) {
+  // elapsed clock time in cycles, wrapping days past 511 into carry
+  uint64_t now = halted ? halted_time : cycles - epoch;
+  if (now >= 512 * cycles_per_day) {
+    carry = true;
+    set_time(now % (512 * cycles_per_day), cycles);
+    now %= 512 * cycles_per_day;
+  }
+  return now;
+}
+
+void RTC::set_time(uint64_t time, uint64_t cycles) {
+  if (halted)
+    halted_time = time;
+  else
+    epoch = cycles - time;
+}
+
+std::array<uint8_t, 5> RTC::registers(uint64_t cycles) {
+  uint64_t secs = time(cycles) / cycles_per_sec;
+  uint64_t days = secs / 86400;
+  uint8_t dh = ((days >> 8) & 0x1) | (halted << 6) | (carry << 7);
+  return {{uint8_t(secs % 60), uint8_t(secs / 60 % 60),
+           uint8_t(secs / 3600 % 24), uint8_t(days & 0xff), dh}};
+}
+
+void RTC::latch(uint8_t val, uint64_t cycles) {
+  // latch current time on 0 then 1 write
+  if (last_latch == 0 && val == 1) latched = registers(cycles);
+  last_latch = val;
+}
+
+void RTC::write(uint8_t reg, uint8_t val, uint64_t cycles) {
+  // rebuild time from registers, writing seconds resets the subsecond count
+  uint64_t now = time(cycles);
+  std::array<uint8_t, 5> regs = registers(cycles);
+  val &= masks[reg - 0x8];
+  regs[reg - 0x8] = val;
+  latched[reg - 0x8] = val;
+  uint64_t sub = reg == 0x8 ? 0 : now % cycles_per_sec;
+  uint64_t days = regs[3] | ((regs[4] & 0x1) << 8);
+  uint64_t secs = regs[0] + regs[1] * 60 + regs[2] * 3600 + days * 86400;
+  halted = (regs[4] >> 6) & 0x1, carry = regs[4] >> 7;
+  set_time(secs * cycles_per_sec + sub, cycles);
+}
+
+// Save Functions
+
+void RTC::save(uint8_t *footer, uint64_t cycles, int64_t unix_time) {
+  // current and latched registers as 32-bit words, then 64-bit timestamp
+  std::array<uint8_t, 5> regs = registers(cycles);
+  for (unsigned i = 0; i < 5; ++i) {
+    put32(footer + i * 4, regs[i]);
+    put32(footer + 20 + i * 4, latched[i]);
+  }
+  put32(footer + 40, uint64_t(unix_time) & 0xffffffff);
+  put32(footer + 44, uint64_t(unix_time) >> 32);
+}
+
+void RTC::load(const uint8_t *footer, uint64_t cycles, int64_t unix_time) {
+  std::array<uint8_t, 5> regs;
+  for (unsigned i = 0; i < 5; ++i) {
+    regs[i] = get32(footer + i * 4) & masks[i];
+    latched[i] = get32(footer + 20 + i * 4) & masks[i];
+  }
+  uint64_t days = regs[3] | ((regs[4] & 0x1) << 8);
+  uint64_t secs = regs[0] + regs[1] * 60 + regs[2] * 3600 + days * 86400;
+  halted = (regs[4] >> 6) & 0x1, carry = regs[4] >> 7;
+
+  // advance running clock by real time passed since save
+  int64_t saved = get32(footer + 40) | (uint64_t(get32(footer + 44)) << 32);
+  if (!halted && unix_time > saved) secs += unix_time - saved;
+  set_time(secs * cycles_per_sec, cycles);
+}
@@ -0,0 +1,38 @@
+#ifndef RTC_H
+#define RTC_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// MBC3 real-time clock, derived from cpu cycles only when observed
+
+class RTC {
+private:
+  // Static Tables
+  static const uint64_t cycles_per_sec = 1 << 20;
+  static const uint64_t cycles_per_day = 86400 * cycles_per_sec;
+  static const std::array<uint8_t, 5> masks;
+
+  // Internal State
+  uint64_t epoch = 0, halted_time = 0;
+  bool halted = false, carry = false;
+  std::array<uint8_t, 5> latched = {{}};
+  uint8_t last_latch = 0xff;
+  uint64_t time(uint64_t cycles);
+  void set_time(uint64_t time, uint64_t cycles);
+  std::array<uint8_t, 5> registers(uint64_t cycles);
+
+public:
+  // Core Functions
+  void latch(uint8_t val, uint64_t cycles);
+  uint8_t read(uint8_t reg) const { return latched[reg - 0x8]; }
+  void write(uint8_t reg, uint8_t val, uint64_t cycles);
+
+  // Save Functions
+  static const size_t footer_size = 48;
+  void save(uint8_t *footer, uint64_t cycles, int64_t unix_time);
+  void load(const uint8_t *footer, uint64_t cycles, int64_t unix_time);
+};
+
+#endif
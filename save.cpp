@@ -0,0 +1,82 @@
+#include "save.h"
+#include <cstdio>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define FRAME_BOY_FSYNC
+#include <unistd.h>
+#endif
+
+// Core Functions
+
+SaveWriter::~SaveWriter() {
+  // finish any queued write before exiting
+  if (!thread.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  cv.notify_all();
+  thread.join();
+}
+
+void SaveWriter::write(const std::string &filename, const uint8_t *data,
+                       size_t size) {
+#ifdef __EMSCRIPTEN__
+  // filesystem is in memory and synced by the page, so write in place
+  failed = !write_file(filename, std::vector<uint8_t>(data, data + size));
+#else
+  // replace any queued write with newest data
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->filename = filename;
+    pending.assign(data, data + size);
+    queued = true;
+  }
+  if (!thread.joinable()) thread = std::thread(&SaveWriter::run, this);
+  cv.notify_all();
+#endif
+}
+
+bool SaveWriter::take_failure() {
+  // report a failed write once, so the caller can queue it again
+  std::lock_guard<std::mutex> lock(mutex);
+  bool result = failed;
+  failed = false;
+  return result;
+}
+
+void SaveWriter::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cv.wait(lock, [this] { return queued || quit; });
+    if (!queued) return;
+    // write outside the lock so the frame loop never waits on disk
+    std::string name = filename;
+    std::vector<uint8_t> data;
+    data.swap(pending);
+    queued = false;
+    lock.unlock();
+    bool ok = write_file(name, data);
+    lock.lock();
+    failed = !ok;
+  }
+}
+
+bool SaveWriter::write_file(const std::string &filename,
+                            const std::vector<uint8_t> &data) {
+  // rename is atomic, so a crash never leaves a truncated save
+  std::string temp = filename + ".tmp";
+  FILE *file = fopen(temp.c_str(), "wb");
+  if (file == nullptr) return false;
+  bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  ok = fflush(file) == 0 && ok;
+#ifdef FRAME_BOY_FSYNC
+  // data must reach disk before rename, or a crash can leave an empty save
+  ok = fsync(fileno(file)) == 0 && ok;
+#endif
+  if (fclose(file) != 0 || !ok) {
+    remove(temp.c_str());
+    return false;
+  }
+  return rename(temp.c_str(), filename.c_str()) == 0;
+}
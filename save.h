@@ -0,0 +1,33 @@
+#ifndef SAVE_H
+#define SAVE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes save files off the frame loop via write-to-temp-and-rename
+
+class SaveWriter {
+private:
+  // Internal State
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::string filename;
+  std::vector<uint8_t> pending;
+  bool queued = false, failed = false, quit = false;
+  void run();
+  static bool write_file(const std::string &filename,
+                         const std::vector<uint8_t> &data);
+
+public:
+  // Core Functions
+  ~SaveWriter();
+  void write(const std::string &filename, const uint8_t *data, size_t size);
+  bool take_failure();
+};
+
+#endif
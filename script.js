@@ -1,10 +1,6 @@
 // register offline service worker
 
-if ('serviceWorker' in navigator) {
-  window.addEventListener('load', () => {
-    navigator.serviceWorker.register('worker.js');
-  });
-}
+registerWorker();
 
 // setup file system
 
@@ -13,33 +9,35 @@ const setup = () => {
   SDL.defaults.copyOnLock = false;
   SDL.defaults.discardOnLock = true;
   SDL.defaults.opaqueFrontBuffer = false;
-
-  // load files from indexedDB
-  FS.mkdir('/data');
-  FS.mount(IDBFS, {}, '/data');
-  FS.syncfs(true, err => {
-    FS.currentPath = '/data';
-    if (!FS.analyzePath('filename.txt').exists) return;
-    lastFilename = FS.readFile('filename.txt', {encoding: 'utf8'});
-    document.getElementById('rom').labels[0].innerHTML = lastFilename + '.gb';
-    if (!FS.analyzePath('ram.sav').exists) return;
-    document.getElementById('ram').labels[0].innerHTML = lastFilename + '.sav';
-  });
+  mountData();
 };
 
 const save = () => {
-  Module._save();
-  FS.syncfs(false, err => {});
+  // only sync indexedDB when save ram actually changed
+  if (Module._save()) FS.syncfs(false, err => {});
 };
 
-const load = () => {
-  if (!FS.analyzePath('rom.gb').exists) return;
-  Module._load();
+const readFile = filename => {
+  // prefer buffers from this session's uploads over indexedDB copies
+  if (uploads.has(filename)) return uploads.get(filename);
+  if (!FS.analyzePath(filename).exists) return new Uint8Array();
+  return FS.readFile(filename);
 };
 
-var lastFilename = '';
-window.onbeforeunload = save;
-document.addEventListener('visibilitychange', save);
+const load = () => {
+  // hand rom and save buffers straight to the core
+  const rom = readFile('rom.gb');
+  if (rom.length == 0) return;
+  const ram = readFile('ram.sav');
+  const romPtr = Module._malloc(rom.length);
+  const ramPtr = Module._malloc(Math.max(ram.length, 1));
+  HEAPU8.set(rom, romPtr);
+  HEAPU8.set(ram, ramPtr);
+  const loaded = Module._load_data(romPtr, rom.length, ramPtr, ram.length);
+  Module._free(romPtr);
+  Module._free(ramPtr);
+  if (!loaded) romError();
+};
 
 // create event listeners
 
@@ -51,65 +49,22 @@ const unlock = () => {
   });
 };
 
-const upload = (input, filename) => {
-  if (input.files.length == 0) return;
-  if (FS.analyzePath('ram.sav').exists) {
-    FS.writeFile('ram.sav', '');
-    document.getElementById('ram').labels[0].innerHTML = 'Select Save';
-  }
-  const file = input.files[0];
-  let fr = new FileReader();
-  fr.readAsArrayBuffer(file);
-  fr.onload = () => {
-    const data = new Uint8Array(fr.result);
-    FS.writeFile(filename, data);
-  };
-  input.labels[0].innerHTML = file.name;
-  lastFilename = file.name.replace(/\.[^/.]+$/, '');
-  FS.writeFile('filename.txt', lastFilename);
-};
-
 const download = () => {
-  Module._save();
-  if (!FS.analyzePath('ram.sav').exists) return;
-  const data = FS.readFile('ram.sav');
+  // copy save ram straight out of the core
+  save();
+  const size = Module._save_size();
+  if (size == 0) return;
+  const ptr = Module._malloc(size);
+  Module._save_data(ptr, size);
+  const data = HEAPU8.slice(ptr, ptr + size);
+  Module._free(ptr);
   const blob = new Blob([data.buffer], {type: 'application/octet-binary'});
   saveAs(blob, lastFilename + '.sav');
 };
 
-const simulateKey = (type, code) => {
-  var event = new KeyboardEvent(type, {
-    'keyCode': code, 'charCode': code, 'view': window,
-    'bubbles': true, 'cancelable': true,
-  });
-  document.body.dispatchEvent(event);
-}
-
 // attach event listeners
 
-document.getElementById('rom')
-  .addEventListener('change', e => upload(e.target, 'rom.gb'));
-document.getElementById('ram')
-  .addEventListener('change', e => upload(e.target, 'ram.sav'));
-document.getElementById('load')
-  .addEventListener('click', load);
-document.getElementById('load')
-  .addEventListener('click', unlock);
-document.getElementById('load')
-  .addEventListener('touchend', unlock);
-document.getElementById('save')
-  .addEventListener('click', download);
-
-const bindings = new Map([
-  ['select', 8], ['start', 13], ['a', 88], ['b', 90],
-  ['left', 37], ['right', 39], ['up', 38], ['down', 40]
-]);
-bindings.forEach((code, id) => {
-  document.getElementById(id + '-btn')
-    .addEventListener('pointerenter', () => simulateKey('keydown', code));
-  document.getElementById(id + '-btn')
-    .addEventListener('pointerleave', () => simulateKey('keyup', code));
-});
+attachControls({save, load, download, unlock});
 
 // load webassembly module
 
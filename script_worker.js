@@ -0,0 +1,94 @@
+// pre-js for the worker build, which is also loaded by pthread workers
+
+if (typeof document !== 'undefined') {
+
+// register offline service worker
+
+registerWorker();
+
+// setup file system
+
+const setup = mountData;
+
+// emulation thread calls back once ram.sav is up to date
+Module.saved = written => {
+  if (written) FS.syncfs(false, err => {});
+  if (!downloadPending || !FS.analyzePath('ram.sav').exists) return;
+  downloadPending = false;
+  const data = FS.readFile('ram.sav');
+  const blob = new Blob([data.buffer], {type: 'application/octet-binary'});
+  saveAs(blob, lastFilename + '.sav');
+};
+
+// emulation thread calls back once rom.gb has been checked
+Module.loaded = valid => {
+  if (!valid) romError();
+};
+
+const save = () => {
+  Module._save(0);
+};
+
+const load = () => {
+  if (!FS.analyzePath('rom.gb').exists) return;
+  Module._load();
+};
+
+var downloadPending = false;
+
+// setup audio worklet reading the shared audio ring, in the core's format
+
+var audioContext = null;
+
+const unlock = async () => {
+  if (audioContext != null) return audioContext.resume();
+  const channels = Module._audio_channels();
+  audioContext = new AudioContext({sampleRate: Module._audio_rate()});
+  await audioContext.audioWorklet.addModule('audio_worklet.js');
+  const node = new AudioWorkletNode(audioContext, 'ring-processor', {
+    outputChannelCount: [channels],
+    processorOptions: {
+      buffer: wasmMemory.buffer, ring: Module._audio_ring(), capacity: 0x2000,
+      channels: channels,
+    },
+  });
+  node.connect(audioContext.destination);
+};
+
+// draw newest frame published by the emulation thread
+
+const lcd = document.getElementById('lcd').getContext('2d');
+const frame = document.createElement('canvas');
+frame.width = 160;
+frame.height = 144;
+const image = frame.getContext('2d').createImageData(160, 144);
+
+const draw = () => {
+  const ptr = Module._frame();
+  if (ptr != 0) {
+    // shared memory can't back ImageData, so copy out first
+    image.data.set(HEAPU8.subarray(ptr, ptr + 160 * 144 * 4));
+    frame.getContext('2d').putImageData(image, 0, 0);
+    lcd.imageSmoothingEnabled = false;
+    lcd.drawImage(frame, 0, 0, lcd.canvas.width, lcd.canvas.height);
+  }
+  requestAnimationFrame(draw);
+};
+
+const download = () => {
+  downloadPending = true;
+  Module._save(1);
+};
+
+// attach event listeners, keys are forwarded to the emulation thread
+
+attachControls({save, load, download, unlock});
+document.addEventListener('keydown', e => Module._key(e.keyCode, 1));
+document.addEventListener('keyup', e => Module._key(e.keyCode, 0));
+
+// load webassembly module
+
+Module.preRun = setup;
+Module.postRun = () => requestAnimationFrame(draw);
+
+}
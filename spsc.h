@@ -0,0 +1,96 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single-producer, single-consumer ring buffer
+
+template <typename T, size_t N> class Ring {
+private:
+  static_assert((N & (N - 1)) == 0, "ring capacity must be a power of 2");
+
+  // Internal State
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+  alignas(64) std::array<T, N> data;
+
+public:
+  // Producer Functions
+  T *write_ptr(size_t &count) {
+    // find contiguous free space at tail
+    size_t end = tail.load(std::memory_order_relaxed);
+    size_t used = end - head.load(std::memory_order_acquire);
+    count = std::min(N - used, N - (end & (N - 1)));
+    return &data[end & (N - 1)];
+  }
+  void commit(size_t count) {
+    tail.store(tail.load(std::memory_order_relaxed) + count,
+               std::memory_order_release);
+  }
+  size_t push(const T *src, size_t count) {
+    size_t pushed = 0;
+    for (size_t i = 0; i < 2 && pushed < count; ++i) {
+      size_t space;
+      T *dst = write_ptr(space);
+      space = std::min(space, count - pushed);
+      std::copy_n(src + pushed, space, dst);
+      commit(space), pushed += space;
+    }
+    return pushed;
+  }
+
+  // Consumer Functions
+  size_t size() const {
+    return tail.load(std::memory_order_acquire) -
+           head.load(std::memory_order_acquire);
+  }
+  size_t pop(T *dst, size_t count) {
+    size_t start = head.load(std::memory_order_relaxed);
+    count = std::min(count, tail.load(std::memory_order_acquire) - start);
+    // copy out in up to two contiguous parts
+    size_t first = std::min(count, N - (start & (N - 1)));
+    std::copy_n(&data[start & (N - 1)], first, dst);
+    std::copy_n(&data[0], count - first, dst + first);
+    head.store(start + count, std::memory_order_release);
+    return count;
+  }
+  static constexpr size_t capacity() { return N; }
+};
+
+// Lock-free triple buffer, consumer sees newest published value
+
+template <typename T> class TripleBuffer {
+private:
+  static const unsigned fresh = 4;
+
+  // Internal State
+  std::array<T, 3> slots;
+  alignas(64) std::atomic<unsigned> middle{1};
+  alignas(64) unsigned back_index = 0;
+  alignas(64) unsigned front_index = 2;
+
+public:
+  // Producer Functions
+  T &back() { return slots[back_index]; }
+  void publish() {
+    // swap back slot into middle and mark it fresh
+    unsigned old =
+        middle.exchange(back_index | fresh, std::memory_order_acq_rel);
+    back_index = old & ~fresh;
+  }
+
+  // Consumer Functions
+  bool update() {
+    // take middle slot only if producer published since last update
+    if (!(middle.load(std::memory_order_relaxed) & fresh)) return false;
+    unsigned old = middle.exchange(front_index, std::memory_order_acq_rel);
+    front_index = old & ~fresh;
+    return true;
+  }
+  const T &front() const { return slots[front_index]; }
+};
+
+#endif
@@ -8,13 +8,6 @@ const std::array<uint8_t, 4> Timer::freq_bits = {9, 3, 5, 7};
 
 Timer::Timer(Memory &mem_in) : mem(mem_in) {
   div = clock >> 8;
-  // reset timer on DIV write
-  mem.wmask(0xff04, 0x0);
-  mem.hook(0xff04, [&](uint8_t) { clock = 0; });
-  mem.hook(0xff07, [&](uint8_t val) {
-    on = read1(val, 2);
-    freq_bit = freq_bits[val & 0x3];
-  });
 }
 
 void Timer::update(unsigned cpu_cycles) {
@@ -23,7 +16,7 @@ void Timer::update(unsigned cpu_cycles) {
     clock += 4;
     if (tima_scheduled) {
       tima = tma;
-      IF = write1(IF, 2, true);
+      mem.request(2);
       tima_scheduled = false;
     }
     bool bit = on && read1(clock, freq_bit);
@@ -32,3 +25,33 @@ void Timer::update(unsigned cpu_cycles) {
   }
   div = clock >> 8;
 }
+
+// I/O Functions
+
+uint8_t Timer::read(uint8_t reg) const {
+  switch (reg) {
+  case 0x04: return div;
+  case 0x05: return tima;
+  case 0x06: return tma;
+  default: return tac;
+  }
+}
+
+void Timer::write(uint8_t reg, uint8_t val) {
+  switch (reg) {
+  case 0x04: // DIV writes only reset timer
+    clock = 0;
+    break;
+  case 0x05:
+    tima = val;
+    break;
+  case 0x06:
+    tma = val;
+    break;
+  case 0x07:
+    tac = val;
+    on = read1(val, 2);
+    freq_bit = freq_bits[val & 0x3];
+    break;
+  }
+}
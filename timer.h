@@ -15,16 +15,17 @@ private:
   uint8_t freq_bit = 9;
 
   // Registers
-  uint8_t &IF = mem.refh(0x0f);
-  uint8_t &div = mem.refh(0x04);
-  uint8_t &tima = mem.refh(0x05);
-  uint8_t &tma = mem.refh(0x06);
-  uint8_t &tac = mem.refh(0x07);
+  uint8_t div = 0, tima = 0, tma = 0, tac = 0;
 
 public:
   // Core Functions
   explicit Timer(Memory &mem_in);
   void update(unsigned cpu_cycles);
+  uint8_t get_div() const { return div; }
+
+  // I/O Functions
+  uint8_t read(uint8_t reg) const;
+  void write(uint8_t reg, uint8_t val);
 };
 
 #endif
@@ -0,0 +1,54 @@
+#include "trace.h"
+#include <cstdio>
+
+// Core Functions
+
+void Tracer::enable(size_t capacity) {
+  // preallocate ring buffer of events
+  events.assign(capacity, Event());
+  epoch = std::chrono::steady_clock::now();
+  next = count = 0;
+  on = capacity != 0;
+}
+
+uint64_t Tracer::now() const {
+  if (!on) return 0;
+  auto elapsed = std::chrono::steady_clock::now() - epoch;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void Tracer::record(const char *name, char phase, uint64_t ts, uint64_t dur) {
+  // overwrite oldest event when full
+  events[next] = {name, phase, ts, dur, cycles};
+  next = (next + 1) % events.size();
+  if (count < events.size()) ++count;
+}
+
+void Tracer::write(const std::string &filename) const {
+  // leave any previous trace alone when nothing was recorded
+  if (events.empty()) return;
+  FILE *file = fopen(filename.c_str(), "w");
+  if (file == nullptr) return;
+  // host spans and guest events go on separate tracks
+  fprintf(file, "{\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                "\"args\":{\"name\":\"host\"}},\n");
+  fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,"
+                "\"args\":{\"name\":\"guest\"}}");
+  size_t first = (next + events.size() - count) % events.size();
+  for (size_t i = 0; i < count; ++i) {
+    const Event &event = events[(first + i) % events.size()];
+    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,", event.name,
+            event.phase);
+    fprintf(file, "\"tid\":%d,\"ts\":%.3f,", event.phase == 'X' ? 1 : 2,
+            event.ts / 1000.0);
+    if (event.phase == 'X')
+      fprintf(file, "\"dur\":%.3f,", event.dur / 1000.0);
+    else
+      fprintf(file, "\"s\":\"t\",");
+    fprintf(file, "\"args\":{\"cycles\":%llu}}",
+            static_cast<unsigned long long>(event.cycles));
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+}
@@ -0,0 +1,42 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Tracer {
+private:
+  // Internal State
+  struct Event {
+    const char *name;
+    char phase;
+    uint64_t ts, dur, cycles;
+  };
+  std::vector<Event> events;
+  std::chrono::steady_clock::time_point epoch;
+  size_t next = 0, count = 0;
+  uint64_t cycles = 0;
+  bool on = false;
+  void record(const char *name, char phase, uint64_t ts, uint64_t dur);
+
+public:
+  // Core Functions
+  void enable(size_t capacity);
+  void disable() { on = false; }
+  bool enabled() const { return on; }
+  void tick(unsigned cpu_cycles) { cycles += cpu_cycles; }
+  uint64_t now() const;
+  void write(const std::string &filename) const;
+
+  // Event Functions
+  void span(const char *name, uint64_t start) {
+    if (on) record(name, 'X', start, now() - start);
+  }
+  void instant(const char *name) {
+    if (on) record(name, 'i', now(), 0);
+  }
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "wav.h"
+#include <algorithm>
+
+// Utility Functions
+
+static void put16(uint8_t *out, uint16_t val) {
+  out[0] = val & 0xff, out[1] = val >> 8;
+}
+
+static void put32(uint8_t *out, uint32_t val) {
+  put16(out, val & 0xffff), put16(out + 2, val >> 16);
+}
+
+// Core Functions
+
+bool WavWriter::open(const std::string &filename, unsigned rate,
+                     unsigned channels) {
+  close();
+  file = fopen(filename.c_str(), "wb");
+  if (file == nullptr) return false;
+  // write 16-bit PCM header, sizes are patched on close
+  uint8_t header[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V',
+                        'E', 'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0};
+  put16(&header[22], channels);
+  put32(&header[24], rate);
+  put32(&header[28], rate * channels * 2);
+  put16(&header[32], channels * 2);
+  put16(&header[34], 16);
+  header[36] = 'd', header[37] = 'a', header[38] = 't', header[39] = 'a';
+  fwrite(header, 1, sizeof(header), file);
+  bytes = 0;
+  return true;
+}
+
+void WavWriter::write_sizes() {
+  uint8_t size[4];
+  put32(size, bytes + 36);
+  fseek(file, 4, SEEK_SET);
+  fwrite(size, 1, 4, file);
+  put32(size, bytes);
+  fseek(file, 40, SEEK_SET);
+  fwrite(size, 1, 4, file);
+}
+
+void WavWriter::write(const int16_t *samples, size_t count) {
+  if (file == nullptr || count == 0) return;
+  // convert to little-endian in small chunks
+  uint8_t chunk[512];
+  for (size_t i = 0; i < count; i += sizeof(chunk) / 2) {
+    size_t n = std::min(count - i, sizeof(chunk) / 2);
+    for (size_t j = 0; j < n; ++j)
+      put16(&chunk[j * 2], samples[i + j]);
+    fwrite(chunk, 2, n, file);
+  }
+  bytes += count * 2;
+}
+
+void WavWriter::close() {
+  if (file == nullptr) return;
+  write_sizes();
+  fclose(file);
+  file = nullptr;
+}
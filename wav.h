@@ -0,0 +1,24 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+class WavWriter {
+private:
+  // Internal State
+  FILE *file = nullptr;
+  uint32_t bytes = 0;
+  void write_sizes();
+
+public:
+  // Core Functions
+  ~WavWriter() { close(); }
+  bool open(const std::string &filename, unsigned rate, unsigned channels);
+  void write(const int16_t *samples, size_t count);
+  void close();
+  bool is_open() const { return file != nullptr; }
+};
+
+#endif